@@ -0,0 +1,30 @@
+#!/bin/sh
+# Copyright 2025, Brian Swetland <swetland@frotz.net>
+# Licensed under the Apache License, Version 2.0.
+
+# usage: bench.sh <emu> "<engines>" <image>...
+#
+# Runs each image under each engine and prints one tab separated
+# line per run: kernel, engine, guest instructions, host seconds,
+# and MIPS.  Exits nonzero if any run fails.
+
+emu=$1
+engines=$2
+shift 2
+
+status=0
+printf 'kernel\tengine\tinsns\tseconds\tmips\n'
+for img in "$@"; do
+	kernel=$(basename "$img" .img)
+	for engine in $engines; do
+		if out=$("$emu" -e "$engine" -si "$img" 2>&1 >/dev/null); then
+			echo "$out" | awk -F'[ =]' -v k="$kernel" -v e="$engine" \
+				'/^stats:/ { printf "%s\t%s\t%s\t%s\t%s\n", k, e, $3, $5, $7 }'
+		else
+			echo "bench: $kernel failed under $engine:" >&2
+			echo "$out" >&2
+			status=1
+		fi
+	done
+done
+exit $status
@@ -0,0 +1,89 @@
+// bitwise CRC32 (IEEE, reflected) of a 64K buffer, 32 times
+
+start:
+	mv s3, ra
+	lui s0, 0x400000
+	mv a0, s0
+	li a1, 16384
+	call fill
+	li s2, 32
+pass:
+	mv a0, s0
+	li a1, 65536
+	call crc32
+	li t0, 0x750ba5d8
+	bne a0, t0, fail
+	subi s2, s2, 1
+	bnez s2, pass
+	mv ra, s3
+	ret
+fail:
+	stx a0, -3
+
+// a0 = buffer, a1 = bytes, returns crc in a0
+crc32:
+	li t0, -1
+	li t5, 0xedb88320
+	add a1, a0, a1
+crc32_loop:
+	ldbu t1, 0(a0)
+	xor t0, t0, t1
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	andi t2, t0, 1
+	neg t2, t2
+	and t2, t2, t5
+	srli t0, t0, 1
+	xor t0, t0, t2
+	addi a0, a0, 1
+	bne a0, a1, crc32_loop
+	not a0, t0
+	ret
+// a0 = dst, a1 = words of xorshift32 data
+fill:
+	li t1, 0x12345678
+fill_loop:
+	slli t0, t1, 13
+	xor t1, t1, t0
+	srli t0, t1, 17
+	xor t1, t1, t0
+	slli t0, t1, 5
+	xor t1, t1, t0
+	stw t1, 0(a0)
+	addi a0, a0, 4
+	subi a1, a1, 1
+	bnez a1, fill_loop
+	ret
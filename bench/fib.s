@@ -0,0 +1,38 @@
+// naive recursive fibonacci: fib(30), 2.7M calls, 4 times
+
+start:
+	mv s3, ra
+	li s2, 4
+pass:
+	li a0, 30
+	call fib
+	li t0, 832040
+	bne a0, t0, fail
+	subi s2, s2, 1
+	bnez s2, pass
+	mv ra, s3
+	ret
+fail:
+	stx a0, -3
+
+// a0 = n, returns fib(n) in a0
+fib:
+	li t0, 2
+	blt a0, t0, fib_done
+	subi sp, sp, 12
+	stw ra, 0(sp)
+	stw s0, 4(sp)
+	stw s1, 8(sp)
+	mv s0, a0
+	subi a0, s0, 1
+	call fib
+	mv s1, a0
+	subi a0, s0, 2
+	call fib
+	add a0, a0, s1
+	ldw ra, 0(sp)
+	ldw s0, 4(sp)
+	ldw s1, 8(sp)
+	addi sp, sp, 12
+fib_done:
+	ret
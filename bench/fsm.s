@@ -0,0 +1,89 @@
+// branch-heavy tokenizer state machine over a 64K buffer, 128 times
+//
+// Bytes (taken mod 64) are digits (0-9), letters (10-35), spaces
+// (36-39), or punctuation, and the machine counts numbers, words,
+// punctuation, and numbers running into letters.
+
+start:
+	mv s3, ra
+	lui s0, 0x400000
+	mv a0, s0
+	li a1, 16384
+	call fill
+	li s2, 128
+pass:
+	mv a0, s0
+	li a1, 65536
+	call tokens
+	li t0, 0xd2ed56de
+	bne a0, t0, fail
+	subi s2, s2, 1
+	bnez s2, pass
+	mv ra, s3
+	ret
+fail:
+	stx a0, -3
+
+// a0 = buffer, a1 = bytes
+// returns numbers ^ (words << 8) ^ (punctuation << 16) ^ (bad << 24)
+tokens:
+	add a1, a0, a1
+	li a2, 0
+	li a3, 0
+	li a4, 0
+	li a5, 0
+	li t2, 0
+	li t3, 2
+tokens_loop:
+	ldbu t0, 0(a0)
+	andi t0, t0, 63
+	li t1, 10
+	blt t0, t1, digit
+	li t1, 36
+	blt t0, t1, letter
+	li t1, 40
+	blt t0, t1, space
+	addi a4, a4, 1
+space:
+	li t2, 0
+	j next
+digit:
+	bnez t2, next
+	addi a2, a2, 1
+	li t2, 1
+	j next
+letter:
+	beq t2, t3, next
+	bnez t2, bad
+	addi a3, a3, 1
+	li t2, 2
+	j next
+bad:
+	addi a5, a5, 1
+	li t2, 2
+next:
+	addi a0, a0, 1
+	bne a0, a1, tokens_loop
+	slli a3, a3, 8
+	slli a4, a4, 16
+	slli a5, a5, 24
+	xor a0, a2, a3
+	xor a0, a0, a4
+	xor a0, a0, a5
+	ret
+
+// a0 = dst, a1 = words of xorshift32 data
+fill:
+	li t1, 0x12345678
+fill_loop:
+	slli t0, t1, 13
+	xor t1, t1, t0
+	srli t0, t1, 17
+	xor t1, t1, t0
+	slli t0, t1, 5
+	xor t1, t1, t0
+	stw t1, 0(a0)
+	addi a0, a0, 4
+	subi a1, a1, 1
+	bnez a1, fill_loop
+	ret
@@ -0,0 +1,168 @@
+// bytecode interpreter running a hash loop of 2.8M virtual ops, twice
+//
+// Each virtual instruction is one word: op | d << 8 | a << 16 | b << 24
+// (or op | d << 8 | imm16 << 16) naming eight virtual registers.
+
+start:
+	mv s5, ra
+	li s6, 2
+pass:
+	la a0, program
+	call vm
+	li t0, 0xdffe8e0c
+	bne a0, t0, fail
+	subi s6, s6, 1
+	bnez s6, pass
+	mv ra, s5
+	ret
+fail:
+	stx a0, -3
+
+// a0 = program, returns virtual r0
+vm:
+	mv s0, a0
+	la s1, vregs
+	la s2, optab
+dispatch:
+	ldw t0, 0(s0)
+	addi s0, s0, 4
+	andi t1, t0, 255
+	slli t1, t1, 2
+	add t1, t1, s2
+	ldw t1, 0(t1)
+	jr t1
+
+op_halt:
+	ldw a0, 0(s1)
+	ret
+op_li:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srai t4, t0, 16
+	stw t4, 0(t2)
+	j dispatch
+op_add:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srli t3, t0, 14
+	andi t3, t3, 0x3fc
+	add t3, t3, s1
+	ldw t3, 0(t3)
+	srli t4, t0, 22
+	andi t4, t4, 0x3fc
+	add t4, t4, s1
+	ldw t4, 0(t4)
+	add t3, t3, t4
+	stw t3, 0(t2)
+	j dispatch
+op_sub:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srli t3, t0, 14
+	andi t3, t3, 0x3fc
+	add t3, t3, s1
+	ldw t3, 0(t3)
+	srli t4, t0, 22
+	andi t4, t4, 0x3fc
+	add t4, t4, s1
+	ldw t4, 0(t4)
+	sub t3, t3, t4
+	stw t3, 0(t2)
+	j dispatch
+op_xor:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srli t3, t0, 14
+	andi t3, t3, 0x3fc
+	add t3, t3, s1
+	ldw t3, 0(t3)
+	srli t4, t0, 22
+	andi t4, t4, 0x3fc
+	add t4, t4, s1
+	ldw t4, 0(t4)
+	xor t3, t3, t4
+	stw t3, 0(t2)
+	j dispatch
+op_shli:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srli t3, t0, 14
+	andi t3, t3, 0x3fc
+	add t3, t3, s1
+	ldw t3, 0(t3)
+	srli t4, t0, 24
+	sll t3, t3, t4
+	stw t3, 0(t2)
+	j dispatch
+op_shri:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srli t3, t0, 14
+	andi t3, t3, 0x3fc
+	add t3, t3, s1
+	ldw t3, 0(t3)
+	srli t4, t0, 24
+	srl t3, t3, t4
+	stw t3, 0(t2)
+	j dispatch
+op_addi:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	srli t3, t0, 14
+	andi t3, t3, 0x3fc
+	add t3, t3, s1
+	ldw t3, 0(t3)
+	srai t4, t0, 24
+	add t3, t3, t4
+	stw t3, 0(t2)
+	j dispatch
+op_bnz:
+	srli t2, t0, 6
+	andi t2, t2, 0x3fc
+	add t2, t2, s1
+	ldw t2, 0(t2)
+	beqz t2, dispatch
+	srai t4, t0, 16
+	slli t4, t4, 2
+	add s0, s0, t4
+	j dispatch
+
+optab:
+	.word op_halt, op_li, op_add, op_sub, op_xor
+	.word op_shli, op_shri, op_addi, op_bnz
+
+vregs:
+	.word 0, 0, 0, 0, 0, 0, 0, 0
+
+// r0 = 1
+// r3 = 400
+// outer:
+//   r1 = 1000
+// inner:
+//   r0 = r0 + (r0 << 5)
+//   r0 = r0 ^ (r0 >> 7)
+//   r0 = r0 + r1
+//   r1 = r1 - 1, loop to inner while nonzero
+//   r3 = r3 - 1, loop to outer while nonzero
+// halt
+program:
+	.word 0x00010001 // li r0, 1
+	.word 0x01900301 // li r3, 400
+	.word 0x03e80101 // li r1, 1000
+	.word 0x05000405 // shli r4, r0, 5
+	.word 0x04000002 // add r0, r0, r4
+	.word 0x07000406 // shri r4, r0, 7
+	.word 0x04000004 // xor r0, r0, r4
+	.word 0x01000002 // add r0, r0, r1
+	.word 0xff010107 // addi r1, r1, -1
+	.word 0xfff90108 // bnz r1, -7
+	.word 0xff030307 // addi r3, r3, -1
+	.word 0xfff60308 // bnz r3, -10
+	.word 0x00000000 // halt
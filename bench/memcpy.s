@@ -0,0 +1,66 @@
+// copy a 64K buffer 2000 times with an unrolled word copy
+
+start:
+	mv s3, ra
+	lui s0, 0x400000
+	lui s1, 0x500000
+	mv a0, s0
+	li a1, 16384
+	call fill
+	li s2, 2000
+pass:
+	mv a0, s1
+	mv a1, s0
+	li a2, 65536
+	call memcpy
+	subi s2, s2, 1
+	bnez s2, pass
+	mv t0, s0
+	mv t1, s1
+	li t2, 16384
+check:
+	ldw t3, 0(t0)
+	ldw t4, 0(t1)
+	bne t3, t4, fail
+	addi t0, t0, 4
+	addi t1, t1, 4
+	subi t2, t2, 1
+	bnez t2, check
+	mv ra, s3
+	ret
+fail:
+	li t0, 1
+	stx t0, -3
+
+// a0 = dst, a1 = src, a2 = bytes (a multiple of 16)
+memcpy:
+	add a3, a1, a2
+memcpy_loop:
+	ldw t0, 0(a1)
+	ldw t1, 4(a1)
+	ldw t2, 8(a1)
+	ldw t3, 12(a1)
+	stw t0, 0(a0)
+	stw t1, 4(a0)
+	stw t2, 8(a0)
+	stw t3, 12(a0)
+	addi a1, a1, 16
+	addi a0, a0, 16
+	bne a1, a3, memcpy_loop
+	ret
+
+// a0 = dst, a1 = words of xorshift32 data
+fill:
+	li t1, 0x12345678
+fill_loop:
+	slli t0, t1, 13
+	xor t1, t1, t0
+	srli t0, t1, 17
+	xor t1, t1, t0
+	slli t0, t1, 5
+	xor t1, t1, t0
+	stw t1, 0(a0)
+	addi a0, a0, 4
+	subi a1, a1, 1
+	bnez a1, fill_loop
+	ret
@@ -0,0 +1,100 @@
+// shellsort 16K random words, 16 times, checking order and sum
+
+start:
+	mv s5, ra
+	lui s6, 0x400000
+	li s7, 16
+pass:
+	mv a0, s6
+	li a1, 16384
+	call fill
+	mv a0, s6
+	li a1, 16384
+	call sum
+	mv s8, a0
+	mv a0, s6
+	li a1, 16384
+	call shellsort
+	mv a0, s6
+	li a1, 16384
+	call sum
+	bne a0, s8, fail
+	mv t0, s6
+	li t1, 16383
+check:
+	ldw t2, 0(t0)
+	ldw t3, 4(t0)
+	blt t3, t2, fail
+	addi t0, t0, 4
+	subi t1, t1, 1
+	bnez t1, check
+	subi s7, s7, 1
+	bnez s7, pass
+	mv ra, s5
+	ret
+fail:
+	li t0, 1
+	stx t0, -3
+
+// a0 = array, a1 = words, returns sum in a0
+sum:
+	li t0, 0
+sum_loop:
+	ldw t1, 0(a0)
+	add t0, t0, t1
+	addi a0, a0, 4
+	subi a1, a1, 1
+	bnez a1, sum_loop
+	mv a0, t0
+	ret
+
+// a0 = array of signed words, a1 = count
+shellsort:
+	slli a1, a1, 2
+	la a2, gaps
+gap_loop:
+	ldw t0, 0(a2)
+	beqz t0, gap_done
+	addi a2, a2, 4
+	slli a3, t0, 2
+	mv a4, a3
+i_loop:
+	bge a4, a1, gap_loop
+	add t1, a0, a4
+	ldw t2, 0(t1)
+	mv t3, a4
+j_loop:
+	blt t3, a3, j_done
+	add t4, a0, t3
+	sub t5, t4, a3
+	ldw t6, 0(t5)
+	ble t6, t2, j_done
+	stw t6, 0(t4)
+	sub t3, t3, a3
+	j j_loop
+j_done:
+	add t4, a0, t3
+	stw t2, 0(t4)
+	addi a4, a4, 4
+	j i_loop
+gap_done:
+	ret
+
+// a0 = dst, a1 = words of xorshift32 data
+fill:
+	li t1, 0x12345678
+fill_loop:
+	slli t0, t1, 13
+	xor t1, t1, t0
+	srli t0, t1, 17
+	xor t1, t1, t0
+	slli t0, t1, 5
+	xor t1, t1, t0
+	stw t1, 0(a0)
+	addi a0, a0, 4
+	subi a1, a1, 1
+	bnez a1, fill_loop
+	ret
+
+gaps:
+	.word 10941, 4861, 2161, 960, 427, 190, 84, 37, 16, 7, 3, 1, 0
@@ -0,0 +1,72 @@
+{ 0xffffffff, 0x00000000, "nop" },
+{ 0x0000f83f, 0x00000000, "li      %t, %i" },
+{ 0xffff003f, 0x00000000, "mv      %t, %a" },
+{ 0x0000003f, 0x00000000, "addi    %t, %a, %i" },
+{ 0xffff003f, 0x00000001, "neg     %t, %a" },
+{ 0x0000003f, 0x00000001, "subi    %t, %a, %i" },
+{ 0x0000003f, 0x00000002, "andi    %t, %a, %i" },
+{ 0x0000003f, 0x00000003, "ori     %t, %a, %i" },
+{ 0xffff003f, 0xffff0004, "not     %t, %a" },
+{ 0x0000003f, 0x00000004, "xori    %t, %a, %i" },
+{ 0x0000003f, 0x00000005, "slli    %t, %a, %i" },
+{ 0x0000003f, 0x00000006, "srli    %t, %a, %i" },
+{ 0x0000003f, 0x00000007, "srai    %t, %a, %i" },
+{ 0x0000003f, 0x00000008, "slti    %t, %a, %i" },
+{ 0xffff003f, 0x00010009, "seqz    %t, %a" },
+{ 0x0000003f, 0x00000009, "sltui   %t, %a, %i" },
+{ 0x0000003f, 0x0000000a, "muli    %t, %a, %i" },
+{ 0x0000003f, 0x0000000b, "divi    %t, %a, %i" },
+{ 0xffe0003f, 0x00000010, "add     %t, %a, %b" },
+{ 0xffe0003f, 0x00000011, "sub     %t, %a, %b" },
+{ 0xffe0003f, 0x00000012, "and     %t, %a, %b" },
+{ 0xffe0003f, 0x00000013, "or      %t, %a, %b" },
+{ 0xffe0003f, 0x00000014, "xor     %t, %a, %b" },
+{ 0xffe0003f, 0x00000015, "sll     %t, %a, %b" },
+{ 0xffe0003f, 0x00000016, "srl     %t, %a, %b" },
+{ 0xffe0003f, 0x00000017, "sra     %t, %a, %b" },
+{ 0xffff003f, 0x00000018, "sltz    %t, %a" },
+{ 0xffe0f83f, 0x00000018, "sgtz    %t, %b" },
+{ 0xffe0003f, 0x00000018, "slt     %t, %a, %b" },
+{ 0xffe0f83f, 0x00000019, "snez    %t, %b" },
+{ 0xffe0003f, 0x00000019, "sltu    %t, %a, %b" },
+{ 0xffe0003f, 0x0000001a, "mul     %t, %a, %b" },
+{ 0xffe0003f, 0x0000001b, "div     %t, %a, %b" },
+{ 0xffe0003f, 0x0000001c, "amoswap %t, %a, %b" },
+{ 0xffe0003f, 0x0000001d, "amoadd  %t, %a, %b" },
+{ 0xffe0003f, 0x0000001e, "amocas  %t, %a, %b" },
+{ 0xffff07ff, 0x0000001f, "jr      %a" },
+{ 0xffff003f, 0x0000001f, "jalr    %t, %a" },
+{ 0x0000003f, 0x0000001f, "jalr    %t, %a, %i" },
+{ 0x0000003f, 0x00000020, "ldw     %t, %i(%a)" },
+{ 0x0000003f, 0x00000021, "ldh     %t, %i(%a)" },
+{ 0x0000003f, 0x00000022, "ldb     %t, %i(%a)" },
+{ 0x0000f83f, 0x00000023, "ldx     %t, %i" },
+{ 0x0000003f, 0x00000023, "ldx     %t, %i(%a)" },
+{ 0x0000003f, 0x00000024, "lui     %t, %U" },
+{ 0x0000003f, 0x00000025, "ldhu    %t, %i(%a)" },
+{ 0x0000003f, 0x00000026, "ldbu    %t, %i(%a)" },
+{ 0x0000003f, 0x00000027, "auipc   %t, %U" },
+{ 0x0000003f, 0x00000028, "stw     %t, %i(%a)" },
+{ 0x0000003f, 0x00000029, "sth     %t, %i(%a)" },
+{ 0x0000003f, 0x0000002a, "stb     %t, %i(%a)" },
+{ 0x0000f83f, 0x0000002b, "stx     %t, %i" },
+{ 0x0000003f, 0x0000002b, "stx     %t, %i(%a)" },
+{ 0x000007ff, 0x00000030, "beqz    %a, %B" },
+{ 0x0000003f, 0x00000030, "beq     %a, %t, %B" },
+{ 0x000007ff, 0x00000031, "bnez    %a, %B" },
+{ 0x0000003f, 0x00000031, "bne     %a, %t, %B" },
+{ 0x000007ff, 0x00000032, "bltz    %a, %B" },
+{ 0x0000f83f, 0x00000032, "bgtz    %t, %B" },
+{ 0x0000003f, 0x00000032, "blt     %a, %t, %B" },
+{ 0x0000003f, 0x00000033, "bltu    %a, %t, %B" },
+{ 0x0000f83f, 0x00000034, "blez    %t, %B" },
+{ 0x000007ff, 0x00000034, "bgez    %a, %B" },
+{ 0x0000003f, 0x00000034, "bge     %a, %t, %B" },
+{ 0x0000003f, 0x00000035, "bgeu    %a, %t, %B" },
+{ 0x000007ff, 0x00000038, "j       %t, %J" },
+{ 0x000007ff, 0x00000078, "call    %t, %J" },
+{ 0x0000003f, 0x00000038, "jal     %t, %J" },
+{ 0x0000003f, 0x00000039, "syscall %i" },
+{ 0x0000003f, 0x0000003a, "break" },
+{ 0x0000003f, 0x0000003b, "sysret" },
+{ 0x00000000, 0x00000000, "unknown" },
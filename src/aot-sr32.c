@@ -0,0 +1,464 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Ahead-of-time translator: SR32 image to C
+//
+// Code is found by following control flow from the entry point and
+// every symbol, decoding with the disassembler's instab tables.  The
+// basic blocks become labels in one function, sr32aot_run(), that
+// keeps the guest registers in locals.  Branches and jal to code it
+// translated are gotos and jalr goes through a switch over all the
+// block addresses.  Anything else (an untranslated jalr target, an
+// instruction instab does not know) returns to the emulator, whose
+// aot engine runs one block of it with the predecode interpreter and
+// then calls back in.  Instruction counts and scheduler events match
+// the other engines.
+//
+// The output is compiled and linked with the emulator sources (see
+// bin/emu-% in the Makefile).  Translated code is never invalidated,
+// so images that modify their own code need another engine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sr32.h"
+#include "image-sr32.h"
+
+void sr32dis(uint32_t pc, uint32_t ins, char *out);
+
+typedef struct {
+	uint32_t mask;
+	uint32_t bits;
+	const char* fmt;
+} sr32ins_t;
+
+static sr32ins_t instab[] = {
+#include <instab.h>
+};
+
+#define AOT_MAX_SEGS 64
+
+// per word flags
+#define W_CODE   1
+#define W_LEADER 2
+
+typedef struct {
+	uint32_t addr;
+	uint32_t size;		// bytes of file data
+	uint8_t *data;
+	uint8_t *flags;		// per word
+} Seg;
+
+static Seg segs[AOT_MAX_SEGS];
+static uint32_t nsegs;
+
+static uint32_t *work;
+static uint32_t nwork;
+static uint32_t maxwork;
+
+static FILE *out;
+
+static void die(const char *msg, const char *fn) {
+	fprintf(stderr, "aot: %s: %s\n", msg, fn);
+	exit(1);
+}
+
+static Seg *seg_find(uint32_t addr) {
+	for (uint32_t n = 0; n < nsegs; n++) {
+		if ((addr - segs[n].addr) < segs[n].size) return segs + n;
+	}
+	return NULL;
+}
+
+// flags of the word at addr, or NULL if it is not in the image
+static uint8_t *word_flags(uint32_t addr) {
+	Seg *seg = seg_find(addr);
+	if ((seg == NULL) || (addr & 3) || ((addr - seg->addr + 4) > seg->size)) {
+		return NULL;
+	}
+	return seg->flags + ((addr - seg->addr) >> 2);
+}
+
+static uint32_t word_rd(uint32_t addr) {
+	Seg *seg = seg_find(addr);
+	uint32_t ins;
+	memcpy(&ins, seg->data + (addr - seg->addr), 4);
+	return ins;
+}
+
+static void load(const char *fn) {
+	ImageHeader hdr;
+	FILE *fp = fopen(fn, "rb");
+	if (fp == NULL) die("cannot open", fn);
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) || (hdr.magic != IMAGE_MAGIC) ||
+		(hdr.version != IMAGE_VERSION)) {
+		die("not an sr32 image", fn);
+	}
+	if (hdr.segcount > AOT_MAX_SEGS) die("too many segments", fn);
+	ImageSegment seg[AOT_MAX_SEGS];
+	if (fread(seg, sizeof(ImageSegment), hdr.segcount, fp) != hdr.segcount) {
+		die("truncated image", fn);
+	}
+	for (uint32_t n = 0; n < hdr.segcount; n++) {
+		if (seg[n].filesz == 0) continue;
+		Seg *s = segs + nsegs++;
+		s->addr = seg[n].addr;
+		s->size = seg[n].filesz;
+		s->data = malloc(s->size);
+		s->flags = calloc(1, (s->size + 3) / 4);
+		if ((s->data == NULL) || (s->flags == NULL)) die("out of memory", fn);
+		if (fseek(fp, seg[n].offset, SEEK_SET) ||
+			(fread(s->data, 1, s->size, fp) != s->size)) {
+			die("truncated image", fn);
+		}
+	}
+	work = malloc(sizeof(uint32_t) * (maxwork = 1024));
+	work[nwork++] = hdr.entry;
+	if (hdr.symcount) {
+		ImageSymbol *sym = malloc(sizeof(ImageSymbol) * hdr.symcount);
+		if (fseek(fp, hdr.symoff, SEEK_SET) ||
+			(fread(sym, sizeof(ImageSymbol), hdr.symcount, fp) != hdr.symcount)) {
+			die("truncated image", fn);
+		}
+		for (uint32_t n = 0; n < hdr.symcount; n++) {
+			if (nwork == maxwork) work = realloc(work, sizeof(uint32_t) * (maxwork *= 2));
+			work[nwork++] = sym[n].addr;
+		}
+		free(sym);
+	}
+	fclose(fp);
+}
+
+enum { K_NORMAL, K_BRANCH, K_JAL, K_JALR, K_SYSCALL, K_STOP };
+
+// how an instruction ends (or does not end) a block; K_STOP for
+// anything instab or the reference core does not define
+static int ins_kind(uint32_t ins) {
+	unsigned n = 0;
+	while ((ins & instab[n].mask) != instab[n].bits) n++;
+	if (!strcmp(instab[n].fmt, "unknown")) return K_STOP;
+	switch ((ins >> 3) & 7) {
+	case 0b000: case 0b001: case 0b010: case 0b011:
+		if ((ins & 15) == IR_JALR) return K_JALR;
+		if (((ins & 15) >= IR_AMOSWAP) && !(ins & 0b010000)) return K_STOP;
+		return K_NORMAL;
+	case 0b100:
+		return K_NORMAL;
+	case 0b101:
+		return ((ins & 7) <= S_STX) ? K_NORMAL : K_STOP;
+	case 0b110:
+		return ((ins & 7) <= B_BGEU) ? K_BRANCH : K_STOP;
+	default:
+		if ((ins & 7) == J_JAL) return K_JAL;
+		if ((ins & 7) == J_SYSCALL) return K_SYSCALL;
+		return K_STOP;
+	}
+}
+
+static void leader(uint32_t addr) {
+	uint8_t *f = word_flags(addr);
+	if ((f == NULL) || (*f & W_LEADER)) return;
+	*f |= W_LEADER;
+	if (nwork == maxwork) work = realloc(work, sizeof(uint32_t) * (maxwork *= 2));
+	work[nwork++] = addr;
+}
+
+// mark the code reachable from a leader
+static void trace(uint32_t addr) {
+	for (;;) {
+		uint8_t *f = word_flags(addr);
+		if ((f == NULL) || (*f & W_CODE)) return;
+		*f |= W_CODE;
+		uint32_t ins = word_rd(addr);
+		switch (ins_kind(ins)) {
+		case K_NORMAL:
+			if (seg_find(addr + 4) != seg_find(addr)) {
+				leader(addr + 4);
+				return;
+			}
+			addr += 4;
+			continue;
+		case K_BRANCH:
+			leader(addr + 4 + get_i16(ins));
+			leader(addr + 4);
+			return;
+		case K_JAL:
+			leader(addr + 4 + get_i21(ins));
+			leader(addr + 4);
+			return;
+		case K_JALR:
+		case K_SYSCALL:
+			leader(addr + 4);
+			return;
+		default:
+			return;
+		}
+	}
+}
+
+static int is_leader(uint32_t addr) {
+	uint8_t *f = word_flags(addr);
+	return f && (*f & W_LEADER);
+}
+
+// guest register as a C expression
+static const char *reg(uint32_t r) {
+	static char buf[4][8];
+	static uint32_t next;
+	if (r == 0) return "0";
+	char *s = buf[next++ & 3];
+	sprintf(s, "r%u", r);
+	return s;
+}
+
+// Ra + i16 as a C expression
+static const char *addr_expr(uint32_t ins) {
+	static char buf[32];
+	uint32_t i = get_i16(ins);
+	if (get_ra(ins) == 0) {
+		sprintf(buf, "0x%xu", i);
+	} else if (i == 0) {
+		sprintf(buf, "%s", reg(get_ra(ins)));
+	} else {
+		sprintf(buf, "%s + 0x%xu", reg(get_ra(ins)), i);
+	}
+	return buf;
+}
+
+static void emit_goto(uint32_t pc) {
+	if (is_leader(pc)) {
+		fprintf(out, "\tgoto L%08x;\n", pc);
+	} else {
+		fprintf(out, "\tEXIT(0x%08xu);\n", pc);
+	}
+}
+
+static void emit_count(uint32_t *count) {
+	if (*count) fprintf(out, "\tcd -= %u;\n", *count);
+	*count = 0;
+}
+
+static const char *alu_fmt[2][12] = {
+	{ // immediate
+		"%s + %d", "%s - %d", "%s & 0x%xu", "%s | 0x%xu",
+		"%s ^ 0x%xu", "%s << %u", "%s >> %u", "(uint32_t) (S32(%s) >> %u)",
+		"(S32(%s) < %d)", "(%s < 0x%xu)", "%s * 0x%xu", "(uint32_t) (S32(%s) / %d)",
+	}, { // register
+		"%s + %s", "%s - %s", "%s & %s", "%s | %s",
+		"%s ^ %s", "%s << (%s & 31)", "%s >> (%s & 31)", "(uint32_t) (S32(%s) >> (%s & 31))",
+		"(S32(%s) < S32(%s))", "(%s < %s)", "%s * %s", "(uint32_t) (S32(%s) / S32(%s))",
+	},
+};
+
+static const char *br_fmt[6] = {
+	"%s == %s", "%s != %s", "S32(%s) < S32(%s)",
+	"%s < %s", "S32(%s) >= S32(%s)", "%s >= %s",
+};
+
+static const char *ld_fn[7] = {
+	"mem_rd32(%s)", "(uint32_t) (int16_t) mem_rd16(%s)",
+	"(uint32_t) (int8_t) mem_rd8(%s)", NULL, NULL,
+	"mem_rd16(%s)", "mem_rd8(%s)",
+};
+
+static const char *st_fn[3] = { "mem_wr32", "mem_wr16", "mem_wr8" };
+
+// emit the block at a leader, returning its end
+static uint32_t emit_block(uint32_t pc) {
+	char dis[128];
+	uint32_t count = 0;
+	fprintf(out, "L%08x:\n", pc);
+	for (;;) {
+		uint32_t ins = word_rd(pc);
+		uint32_t next = pc + 4;
+		uint32_t t = get_rt(ins);
+		uint32_t i = get_i16(ins);
+		int kind = ins_kind(ins);
+		const char *a = reg(get_ra(ins));
+		sr32dis(pc, ins, dis);
+		fprintf(out, "\t// %08x: %s\n", pc, dis);
+		if ((kind == K_STOP) || (((ins & 63) == IR_DIV) && (i == 0))) {
+			// left to the interpreter (divi by 0 would not compile cleanly)
+			emit_count(&count);
+			fprintf(out, "\tEXIT(0x%08xu);\n", pc);
+			return next;
+		}
+		count++;
+		switch ((ins >> 3) & 7) {
+		case 0b000: case 0b001: case 0b010: case 0b011: { // I/R
+			uint32_t op = ins & 15;
+			int rform = (ins >> 4) & 1;
+			const char *b = reg(get_rb(ins));
+			if (op == IR_JALR) {
+				if (rform) {
+					fprintf(out, "\tpc = %s + %s;\n", a, b);
+				} else {
+					fprintf(out, "\tpc = %s;\n", addr_expr(ins));
+				}
+				if (t) fprintf(out, "\t%s = 0x%08xu;\n", reg(t), next);
+				emit_count(&count);
+				fprintf(out, "\tif (cd <= 0) SCHED();\n\tgoto dispatch;\n");
+				return next;
+			}
+			if (op >= IR_AMOSWAP) {
+				fprintf(out, "\tn = mem_amo32(%u, %s, %s, %s);\n", op, a, reg(t), b);
+				if (t) fprintf(out, "\t%s = n;\n", reg(t));
+				break;
+			}
+			if (t == 0) break;
+			fprintf(out, "\t%s = ", reg(t));
+			if (rform) {
+				fprintf(out, alu_fmt[1][op], a, b);
+			} else if ((op >= IR_SLL) && (op <= IR_SRA)) {
+				fprintf(out, alu_fmt[0][op], a, i & 31);
+			} else {
+				fprintf(out, alu_fmt[0][op], a, (int32_t) i);
+			}
+			fprintf(out, ";\n");
+			break;
+		}
+		case 0b100: // L
+			switch (ins & 7) {
+			case L_LDX:
+				emit_count(&count);
+				fprintf(out, "\ta = %s;\n\tSAVE();\n\ts->pc = 0x%08xu;\n", addr_expr(ins), next);
+				fprintf(out, "\tn = io_rd32(s, a);\n\tLOAD();\n");
+				if (t) fprintf(out, "\t%s = n;\n", reg(t));
+				break;
+			case L_LUI:
+				if (t) fprintf(out, "\t%s = 0x%08xu;\n", reg(t), ins & 0xFFFF0000);
+				break;
+			case L_AUIPC:
+				if (t) fprintf(out, "\t%s = 0x%08xu;\n", reg(t), next + (ins & 0xFFFF0000));
+				break;
+			default:
+				if (t == 0) break;
+				fprintf(out, "\t%s = ", reg(t));
+				fprintf(out, ld_fn[ins & 7], addr_expr(ins));
+				fprintf(out, ";\n");
+				break;
+			}
+			break;
+		case 0b101: // S
+			if ((ins & 7) == S_STX) {
+				emit_count(&count);
+				fprintf(out, "\ta = %s;\n\tn = %s;\n\tSAVE();\n\ts->pc = 0x%08xu;\n",
+					addr_expr(ins), reg(t), next);
+				fprintf(out, "\tio_wr32(s, a, n);\n\tLOAD();\n");
+			} else {
+				fprintf(out, "\t%s(%s, %s);\n", st_fn[ins & 7], addr_expr(ins), reg(t));
+			}
+			break;
+		case 0b110: // B
+			emit_count(&count);
+			fprintf(out, "\tif (cd <= 0) SCHED();\n\tif (");
+			if (get_ra(ins) == t) {
+				// beq, bge, bgeu always taken, the others never
+				fprintf(out, ((1 << (ins & 7)) & 0b110001) ? "1" : "0");
+			} else {
+				fprintf(out, br_fmt[ins & 7], a, reg(t));
+			}
+			fprintf(out, ") {\n\t");
+			emit_goto(next + i);
+			fprintf(out, "\t}\n");
+			if (!is_leader(next)) emit_goto(next);
+			return next;
+		case 0b111: // J
+			if ((ins & 7) == J_JAL) {
+				if (t) fprintf(out, "\t%s = 0x%08xu;\n", reg(t), next);
+				emit_count(&count);
+				fprintf(out, "\tif (cd <= 0) SCHED();\n");
+				emit_goto(next + get_i21(ins));
+			} else {
+				emit_count(&count);
+				fprintf(out, "\tSAVE();\n\ts->pc = 0x%08xu;\n", next);
+				fprintf(out, "\tif (s->countdown <= 0) sched_run(s);\n");
+				fprintf(out, "\tdo_syscall(s, %u);\n\tLOAD();\n", get_i21(ins));
+				if (!is_leader(next)) emit_goto(next);
+			}
+			return next;
+		}
+		pc = next;
+		uint8_t *f = word_flags(pc);
+		if ((f == NULL) || !(*f & W_CODE)) {
+			emit_count(&count);
+			fprintf(out, "\tEXIT(0x%08xu);\n", pc);
+			return pc;
+		}
+		if (*f & W_LEADER) {
+			// falls into the next block
+			emit_count(&count);
+			return pc;
+		}
+	}
+}
+
+static int cmp_seg(const void *_a, const void *_b) {
+	const Seg *a = _a;
+	const Seg *b = _b;
+	return (a->addr < b->addr) ? -1 : ((a->addr > b->addr) ? 1 : 0);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: aot <image> <out.c>\n");
+		return 1;
+	}
+	load(argv[1]);
+	qsort(segs, nsegs, sizeof(Seg), cmp_seg);
+
+	// the entry point and symbols are leaders too
+	uint32_t count = nwork;
+	nwork = 0;
+	for (uint32_t n = 0; n < count; n++) {
+		uint32_t addr = work[n];
+		uint8_t *f = word_flags(addr);
+		if (f && !(*f & W_LEADER)) {
+			*f |= W_LEADER;
+			work[nwork++] = addr;
+		}
+	}
+	while (nwork > 0) {
+		trace(work[--nwork]);
+	}
+
+	if ((out = fopen(argv[2], "w")) == NULL) die("cannot create", argv[2]);
+	fprintf(out, "// generated by aot from %s\n\n", argv[1]);
+	fprintf(out, "#include <emulator-sr32.h>\n\n");
+	fprintf(out, "#define S32(x) ((int32_t) (x))\n");
+	fprintf(out, "#define SAVE() do {");
+	for (uint32_t r = 1; r < 32; r++) fprintf(out, " s->r[%u] = r%u;", r, r);
+	fprintf(out, " s->countdown = cd; } while (0)\n");
+	fprintf(out, "#define LOAD() do {");
+	for (uint32_t r = 1; r < 32; r++) fprintf(out, " r%u = s->r[%u];", r, r);
+	fprintf(out, " cd = s->countdown; } while (0)\n");
+	fprintf(out, "#define SCHED() do { SAVE(); sched_run(s); LOAD(); } while (0)\n");
+	fprintf(out, "#define EXIT(x) do { SAVE(); s->pc = (x); return; } while (0)\n\n");
+	fprintf(out, "void sr32aot_run(CpuState *s) {\n\tuint32_t");
+	for (uint32_t r = 1; r < 32; r++) fprintf(out, " r%u,", r);
+	fprintf(out, " pc;\n\tint32_t cd;\n");
+	fprintf(out, "\tuint32_t a __attribute__((unused)), n __attribute__((unused));\n");
+	fprintf(out, "\tLOAD();\n\tpc = s->pc;\ndispatch: __attribute__((unused));\n\tswitch (pc) {\n");
+	for (uint32_t n = 0; n < nsegs; n++) {
+		Seg *seg = segs + n;
+		for (uint32_t w = 0; w < (seg->size / 4); w++) {
+			if (seg->flags[w] & W_LEADER) {
+				uint32_t pc = seg->addr + w * 4;
+				fprintf(out, "\tcase 0x%08xu: goto L%08x;\n", pc, pc);
+			}
+		}
+	}
+	fprintf(out, "\t}\n\tEXIT(pc);\n");
+	for (uint32_t n = 0; n < nsegs; n++) {
+		Seg *seg = segs + n;
+		for (uint32_t w = 0; w < (seg->size / 4); w++) {
+			if (seg->flags[w] & W_LEADER) {
+				emit_block(seg->addr + w * 4);
+			}
+		}
+	}
+	fprintf(out, "}\n");
+	if (fclose(out)) die("cannot write", argv[2]);
+	return 0;
+}
@@ -9,8 +9,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "sr32.h"
+#include "image-sr32.h"
+#include "object-sr32.h"
 
 #define RBUFSIZE 4096
 #define SMAXSIZE 1024
@@ -41,71 +44,123 @@ int fits_in_signed16(uint32_t n) {
 	return ((n == 0) || (n == 0xFFFF8000));
 }
 
-uint8_t image[1*1024*1024];
-uint32_t image_base = 0;
-uint32_t image_size = 0;
-uint32_t PC = 0;
+// Code and data are assembled into sections, each at an offset
+// from its origin, in growable buffers.  Origins are given by the
+// section directives or chosen once assembly is done, after which
+// labels and fixups are resolved.  The bss section has no buffer.
+struct section {
+	const char *name;
+	uint8_t *data;
+	uint32_t cap;		// bytes allocated to data
+	uint32_t pc;		// bytes assembled, while not the current section
+	uint32_t origin;
+	unsigned placed;	// origin given by a directive
+};
 
-void wr32(uint32_t addr, uint32_t val) {
-	addr &= ~3;
-	addr -= image_base;
-	if (addr < image_size) {
-		*((uint32_t*) (image + addr)) = val;
+struct section sections[SECTION_COUNT] = {
+	[SECTION_TEXT] = { .name = ".text" },
+	[SECTION_RODATA] = { .name = ".rodata" },
+	[SECTION_DATA] = { .name = ".data" },
+	[SECTION_BSS] = { .name = ".bss" },
+};
+
+#define IMAGE_BASE 0x100000
+
+struct section *sec = sections;	// current section
+uint32_t PC = 0;		// offset in the current section
+
+// assembling a relocatable object rather than an image
+int objmode = 0;
+
+// pointer to len bytes at offset addr in s, grown as needed
+uint8_t *secdata(struct section *s, uint32_t addr, uint32_t len) {
+	if (s == sections + SECTION_BSS) {
+		die("cannot place data in .bss");
+	}
+	if ((addr + len) < addr) {
+		die("%s is too large", s->name);
 	}
+	if ((addr + len) > s->cap) {
+		uint64_t cap = s->cap ? s->cap : 4096;
+		while (cap < (addr + len)) cap *= 2;
+		uint8_t *data = realloc(s->data, cap);
+		if (data == NULL) die("out of memory");
+		memset(data + s->cap, 0, cap - s->cap);
+		s->data = data;
+		s->cap = cap;
+	}
+	return s->data + addr;
+}
+
+void wr32(struct section *s, uint32_t addr, uint32_t val) {
+	*((uint32_t*) secdata(s, addr & ~3, 4)) = val;
 }
-uint32_t rd32(uint32_t addr) {
+uint32_t rd32(struct section *s, uint32_t addr) {
 	addr &= ~3;
-	addr -= image_base;
-	if (addr < image_size) {
-		return *((uint32_t*) (image + addr));
+	if ((addr + 4) <= s->cap) {
+		return *((uint32_t*) (s->data + addr));
 	}
 	return 0;
 }
 void wr8(uint32_t addr, uint32_t val) {
-	addr -= image_base;
-	if (addr < image_size) {
-		image[addr] = val;
-	}
+	*secdata(sec, addr, 1) = val;
+}
+
+// bytes assembled into a section
+uint32_t secsize(struct section *s) {
+	return (s == sec) ? PC : s->pc;
 }
 
-#define TYPE_PCREL_S16	1
-#define TYPE_PCREL_S21	2
-#define TYPE_ABS_U32	3
-#define TYPE_ABS_HILO   4
-#define TYPE_PCREL_HILO 5
+void setsection(unsigned n) {
+	sec->pc = PC;
+	sec = sections + n;
+	PC = sec->pc;
+}
 
 struct fixup {
 	struct fixup *next;
-	unsigned pc;
+	unsigned sec;
+	unsigned pc;		// offset in sec
 	unsigned type;
+	unsigned line;
 };
 
 struct label {
-	struct label *next;
+	struct label *next;	// all labels, most recently created first
+	struct label *hnext;	// same name hash bucket
+	struct label *pnext;	// same pc bucket (see index_labels())
 	struct fixup *fixups;
 	const char *name;
-	unsigned pc;
+	unsigned pc;		// offset in sec, until resolve() makes it an address
+	unsigned sec;
 	unsigned defined;
+	unsigned abs;		// .equ value rather than an address
+	unsigned global;
+	unsigned index;		// in an object's symbols
 };
 
 struct label *labels;
 struct fixup *fixups;
 
-uint32_t do_fixup(const char *name, uint32_t addr, uint32_t tgt, int type) {
+void do_fixup(const char *name, struct fixup *f, uint32_t tgt) {
+	struct section *s = sections + f->sec;
+	uint32_t off = f->pc;
+	uint32_t addr = s->origin + off;
 	uint32_t n = tgt;
-	switch(type) {
+	linenumber = f->line;
+	switch(f->type) {
 	case TYPE_PCREL_S16:
 		n = n - (addr + 4);
 		if (!is_signed16(n)) goto oops;
-		wr32(addr, rd32(addr) | (n << 16));
+		wr32(s, off, rd32(s, off) | (n << 16));
 		break;
 	case TYPE_PCREL_S21:
 		n = n - (addr + 4);
 		if (!is_signed21(n)) goto oops;
-		wr32(addr, rd32(addr) | (n << 11));
+		wr32(s, off, rd32(s, off) | (n << 11));
 		break;
 	case TYPE_ABS_U32:
-		wr32(addr, n);
+		wr32(s, off, n);
 		break;
 	case TYPE_PCREL_HILO:
 		n = n - (addr + 4);
@@ -113,75 +168,191 @@ uint32_t do_fixup(const char *name, uint32_t addr, uint32_t tgt, int type) {
 		uint32_t hi = n >> 16;
 		uint32_t lo = n & 0xffff;
 		if (lo & 0x8000) hi += 1;
-		n = (hi << 16) | lo;
-		wr32(addr + 0, rd32(addr + 0) | (hi << 16));
-		wr32(addr + 4, rd32(addr + 4) | (lo << 16));
+		wr32(s, off + 0, rd32(s, off + 0) | (hi << 16));
+		wr32(s, off + 4, rd32(s, off + 4) | (lo << 16));
 		break;
 	default:
-		die("unknown branch type %d\n", type);
+		die("unknown branch type %d\n", f->type);
 	}
-	return n;
+	return;
 oops:
 	die("label '%s' at %08x is out of range of %08x\n", name, tgt, addr);
-	return 0;
 }
 
-void setlabel(const char *name, unsigned pc) {
-	struct label *l;
-	struct fixup *f;
+// Labels are hashed by name, ignoring case, since definitions
+// match names regardless of case while uses match exactly.
+// The table doubles whenever it averages a label per bucket.
+static struct label **label_hash;
+static unsigned label_buckets;
+static unsigned label_count;
 
-	for (l = labels; l; l = l->next) {
-		if (!strcasecmp(l->name, name)) {
-			if (l->defined) die("cannot redefine '%s'", name);
-			l->pc = pc;
-			l->defined = 1;
-			for (f = l->fixups; f; f = f->next) {
-				do_fixup(name, f->pc, l->pc, f->type);
+// pc to label index for listings, built once all are defined
+static struct label **label_pcs;
+static unsigned label_pcs_buckets;
+
+static unsigned hash_name(const char *name) {
+	unsigned h = 2166136261u;
+	while (*name) {
+		h = (h ^ tolower((unsigned char) *name++)) * 16777619u;
+	}
+	return h;
+}
+
+static unsigned hash_pc(unsigned pc) {
+	return (pc >> 2) * 2654435761u;
+}
+
+static struct label **alloc_buckets(unsigned count) {
+	struct label **b = calloc(count, sizeof(*b));
+	if (b == NULL) die("out of memory");
+	return b;
+}
+
+// chains keep their relative order, so the most recently created
+// label still comes first among those with the same name
+static void grow_labels(void) {
+	unsigned count = label_buckets ? label_buckets * 2 : 1024;
+	struct label **b = alloc_buckets(count);
+	struct label **tail = alloc_buckets(count);
+	for (unsigned n = 0; n < label_buckets; n++) {
+		struct label *l = label_hash[n];
+		while (l) {
+			struct label *next = l->hnext;
+			unsigned h = hash_name(l->name) & (count - 1);
+			l->hnext = NULL;
+			if (tail[h]) {
+				tail[h]->hnext = l;
+			} else {
+				b[h] = l;
 			}
-			return;
+			tail[h] = l;
+			l = next;
 		}
 	}
-	l = malloc(sizeof(*l));
+	free(tail);
+	free(label_hash);
+	label_hash = b;
+	label_buckets = count;
+}
+
+static struct label *newlabel(const char *name, unsigned pc, unsigned defined) {
+	struct label *l = malloc(sizeof(*l));
+	if (l == NULL) die("out of memory");
+	if (label_count >= label_buckets) {
+		grow_labels();
+	}
+	unsigned h = hash_name(name) & (label_buckets - 1);
 	l->name = name;
 	l->pc = pc;
 	l->fixups = 0;
-	l->defined = 1;
+	l->sec = 0;
+	l->defined = defined;
+	l->abs = 0;
+	l->global = 0;
 	l->next = labels;
 	labels = l;
+	l->hnext = label_hash[h];
+	label_hash[h] = l;
+	label_count++;
+	return l;
+}
+
+static struct label *findlabel(const char *name, int (*cmp)(const char *, const char *)) {
+	if (label_buckets == 0) return NULL;
+	struct label *l = label_hash[hash_name(name) & (label_buckets - 1)];
+	for (; l; l = l->hnext) {
+		if (!cmp(l->name, name)) return l;
+	}
+	return NULL;
+}
+
+// Whether the assembler can resolve use f of l.  In an object,
+// only pc relative uses of addresses in the same section and
+// absolute uses of .equ values can be.  The rest are left for
+// the linker.
+int resolvable(struct label *l, struct fixup *f) {
+	if (!objmode) return 1;
+	if (!l->defined) return 0;
+	if (l->abs) {
+		return (f->type == TYPE_ABS_U32) || (f->type == TYPE_ABS_HILO);
+	} else {
+		return (l->sec == f->sec) && ((f->type == TYPE_PCREL_S16) ||
+			(f->type == TYPE_PCREL_S21) || (f->type == TYPE_PCREL_HILO));
+	}
+}
+
+void setlabel(const char *name, unsigned pc, unsigned abs) {
+	struct label *l;
+
+	l = findlabel(name, strcasecmp);
+	if (l) {
+		if (l->defined) die("cannot redefine '%s'", name);
+		l->pc = pc;
+		l->defined = 1;
+	} else {
+		l = newlabel(name, pc, 1);
+	}
+	l->abs = abs;
+	l->sec = sec - sections;
+}
+
+void globallabel(const char *name) {
+	struct label *l = findlabel(name, strcmp);
+	if (l == NULL) {
+		l = newlabel(strdup(name), 0, 0);
+	}
+	l->global = 1;
+}
+
+// Index the labels by pc, first created last so each bucket
+// chain leads with the most recently created label at a pc.
+static void index_labels(void) {
+	unsigned count = 1024;
+	while (count < label_count) count *= 2;
+	free(label_pcs);
+	label_pcs = alloc_buckets(count);
+	label_pcs_buckets = count;
+	struct label **all = malloc(sizeof(*all) * (label_count + 1));
+	if (all == NULL) die("out of memory");
+	unsigned n = 0;
+	for (struct label *l = labels; l; l = l->next) {
+		all[n++] = l;
+	}
+	while (n > 0) {
+		struct label *l = all[--n];
+		unsigned h = hash_pc(l->pc) & (count - 1);
+		l->pnext = label_pcs[h];
+		label_pcs[h] = l;
+	}
+	free(all);
 }
 
 const char *getlabel(unsigned pc) {
 	struct label *l;
-	for (l = labels; l; l = l->next)
+	if (label_pcs == NULL) index_labels();
+	for (l = label_pcs[hash_pc(pc) & (label_pcs_buckets - 1)]; l; l = l->pnext)
 		if (l->pc == pc)
 			return l->name;
 	return 0;
 }
 
+// Record a use of a label by the word(s) at pc in the current
+// section, to be fixed up by resolve().  Returns the value of the
+// field to assemble, which is 0.
 uint32_t uselabel(const char *name, unsigned pc, unsigned type) {
 	struct label *l;
 	struct fixup *f;
 
-	for (l = labels; l; l = l->next) {
-		if (!strcmp(l->name, name)) {
-			if (l->defined) {
-				return do_fixup(name, pc, l->pc, type);
-			} else {
-				goto add_fixup;
-			}
-		}
+	l = findlabel(name, strcmp);
+	if (l == NULL) {
+		l = newlabel(strdup(name), 0, 0);
 	}
-	l = malloc(sizeof(*l));
-	l->name = strdup(name);
-	l->pc = 0;
-	l->fixups = 0;
-	l->defined = 0;
-	l->next = labels;
-	labels = l;
-add_fixup:
 	f = malloc(sizeof(*f));
+	if (f == NULL) die("out of memory");
+	f->sec = sec - sections;
 	f->pc = pc;
 	f->type = type;
+	f->line = linenumber;
 	f->next = l->fixups;
 	l->fixups = f;
 	return 0;
@@ -190,12 +361,56 @@ add_fixup:
 void checklabels(void) {
 	struct label *l;
 	for (l = labels; l; l = l->next) {
-		if (!l->defined) {
+		// an object's undefined labels are resolved by the linker
+		if (!l->defined && !objmode) {
 			die("undefined label '%s'", l->name);
 		}
 	}
 }
 
+// Place the sections not placed by directives, each following the
+// one before at the next IMAGE_ALIGN boundary so that it may be
+// mapped directly, then give labels their addresses and fix up
+// their uses.  Objects leave every section at 0, for the linker.
+void resolve(void) {
+	struct section *s;
+	struct label *l;
+	struct fixup *f;
+	uint64_t next = IMAGE_BASE;
+
+	for (s = sections; s < (sections + SECTION_COUNT); s++) {
+		if (objmode) break;
+		if (!s->placed) {
+			s->origin = (s == sections) ? next :
+				(next + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+		}
+		next = (uint64_t) s->origin + secsize(s);
+		if (next > 0x100000000ULL) die("%s does not fit below 4GB", s->name);
+	}
+	for (s = sections; s < (sections + SECTION_COUNT); s++) {
+		if (objmode) break;
+		for (struct section *t = s + 1; t < (sections + SECTION_COUNT); t++) {
+			if (secsize(s) && secsize(t) &&
+				(s->origin < (t->origin + secsize(t))) &&
+				(t->origin < (s->origin + secsize(s)))) {
+				die("%s and %s overlap", s->name, t->name);
+			}
+		}
+	}
+	for (l = labels; l; l = l->next) {
+		if (l->defined && !l->abs) {
+			l->pc += sections[l->sec].origin;
+		}
+	}
+	for (l = labels; l; l = l->next) {
+		for (f = l->fixups; f; f = f->next) {
+			if (resolvable(l, f)) {
+				do_fixup(l->name, f, l->pc);
+			}
+		}
+	}
+}
+
 void sr32dis(uint32_t pc, uint32_t ins, char *out);
 
 void emit(uint32_t instr) {
@@ -203,32 +418,258 @@ void emit(uint32_t instr) {
 		PC = (PC + 3) & ~3;
 	}
 	//fprintf(stderr,"{%08x:%08x} ", PC, instr);
-	wr32(PC, instr);
+	wr32(sec, PC, instr);
 	PC += 4;
 }
 
-void save(const char *fn) {
+// data sections, rounded up to whole words
+uint32_t secfilesz(struct section *s) {
+	if (s == (sections + SECTION_BSS)) return 0;
+	return (secsize(s) + 3) & ~3;
+}
+
+// Listings are formatted in chunks of up to LIST_CHUNK words,
+// each into its own buffer on its own thread, then written in order.
+#define LIST_CHUNK   16384
+#define LIST_THREADS 64
+
+typedef struct {
+	struct section *s;
+	uint32_t start;		// offsets in s of the words to list
+	uint32_t end;
+	char *buf;
+	size_t len;
+	size_t cap;
+	pthread_t thread;
+} ListChunk;
+
+void list_printf(ListChunk *c, const char *fmt, ...) {
+	va_list ap;
+	for (;;) {
+		va_start(ap, fmt);
+		int n = vsnprintf(c->buf + c->len, c->cap - c->len, fmt, ap);
+		va_end(ap);
+		if ((c->len + n) < c->cap) {
+			c->len += n;
+			return;
+		}
+		c->cap = (c->cap ? c->cap * 2 : 4096) + n;
+		c->buf = realloc(c->buf, c->cap);
+		if (c->buf == NULL) die("out of memory");
+	}
+}
+
+void *list_chunk(void *arg) {
+	ListChunk *c = arg;
+	struct section *s = c->s;
 	const char *name;
-	uint32_t n;
 	char dis[128];
 
-	FILE *fp = fopen(fn, "w");
-	if (!fp) die("cannot write to '%s'", fn);
-	for (n = image_base; n < PC; n += 4) {
-		uint32_t ins = rd32(n);
-		sr32dis(n, ins, dis);
-		name = getlabel(n);
+	if ((c->start == 0) && (s != sections)) {
+		uint32_t size = (secsize(s) + 3) & ~3;
+		list_printf(c, "// %s %08x-%08x\n", s->name, s->origin, s->origin + size - 1);
+	}
+	for (uint32_t n = c->start; n < c->end; n += 4) {
+		uint32_t addr = s->origin + n;
+		uint32_t ins = rd32(s, n);
+		sr32dis(addr, ins, dis);
+		name = getlabel(addr);
 		char bs[8] = "000000 ";
 		for (unsigned i = 0; i < 6; i++) {
 			if (ins & (1<<i)) bs[5-i] = '1';
 		}
 		if (name) {
-			fprintf(fp, "%08x: %08x // %s %-25s <- %s\n", n, ins, bs, dis, name);
+			list_printf(c, "%08x: %08x // %s %-25s <- %s\n", addr, ins, bs, dis, name);
 		} else {
-			fprintf(fp, "%08x: %08x // %s %s\n", n, ins, bs, dis);
+			list_printf(c, "%08x: %08x // %s %s\n", addr, ins, bs, dis);
 		}
 	}
-	fclose(fp);
+	return NULL;
+}
+
+void save(const char *fn) {
+	ListChunk chunk[LIST_THREADS + SECTION_COUNT];
+	unsigned count = 0;
+
+	// spread the words over the cpus, in chunks no larger than LIST_CHUNK
+	uint64_t words = 0;
+	for (struct section *s = sections; s < (sections + SECTION_COUNT); s++) {
+		words += secfilesz(s) / 4;
+	}
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1) cpus = 1;
+	uint64_t per = (words + cpus - 1) / cpus;
+	if (per < LIST_CHUNK) per = LIST_CHUNK;
+	if (per < ((words + LIST_THREADS - 1) / LIST_THREADS)) {
+		per = (words + LIST_THREADS - 1) / LIST_THREADS;
+	}
+	per *= 4;
+
+	for (struct section *s = sections; s < (sections + SECTION_COUNT); s++) {
+		if (secsize(s) == 0) continue;
+		uint32_t start = 0;
+		do {
+			ListChunk *c = chunk + count++;
+			memset(c, 0, sizeof(*c));
+			c->s = s;
+			c->start = start;
+			c->end = ((secfilesz(s) - start) > per) ? (start + per) : secfilesz(s);
+			start = c->end;
+		} while (start < secfilesz(s));
+	}
+
+	// the pc index is built once, before any thread needs it
+	getlabel(0);
+	for (unsigned n = 1; n < count; n++) {
+		if (pthread_create(&chunk[n].thread, NULL, list_chunk, chunk + n)) {
+			die("cannot create thread");
+		}
+	}
+	if (count) list_chunk(chunk);
+
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	for (unsigned n = 0; n < count; n++) {
+		if (n) pthread_join(chunk[n].thread, NULL);
+		fwrite(chunk[n].buf, 1, chunk[n].len, fp);
+		free(chunk[n].buf);
+	}
+	if (fclose(fp)) die("error writing '%s'", fn);
+}
+
+// The file backed sections as one flat block of memory, from the
+// lowest to the highest address assembled into, gaps zeroed.
+void save_raw(const char *fn) {
+	struct section *s;
+	uint64_t lo = 0x100000000ULL, hi = 0;
+	for (s = sections; s < (sections + SECTION_COUNT); s++) {
+		if (secfilesz(s) == 0) continue;
+		if (s->origin < lo) lo = s->origin;
+		if ((s->origin + secfilesz(s)) > hi) hi = s->origin + secfilesz(s);
+	}
+	if (hi < lo) hi = lo = 0;
+	uint8_t *raw = calloc(1, (hi - lo) ? (hi - lo) : 1);
+	if (raw == NULL) die("out of memory");
+	for (s = sections; s < (sections + SECTION_COUNT); s++) {
+		if (secfilesz(s) == 0) continue;
+		memcpy(raw + (s->origin - lo), s->data, secfilesz(s));
+	}
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	if ((hi > lo) && (fwrite(raw, hi - lo, 1, fp) != 1)) die("error writing '%s'", fn);
+	if (fclose(fp)) die("error writing '%s'", fn);
+	free(raw);
+}
+
+// One segment per section in use, bss taking no file space.
+void save_image(const char *fn) {
+	ImageHeader hdr;
+	ImageSegment seg[SECTION_COUNT];
+	struct section *segsec[SECTION_COUNT];
+	ImageSymbol sym;
+	struct section *s;
+	struct label *l;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = IMAGE_MAGIC;
+	hdr.version = IMAGE_VERSION;
+	hdr.entry = sections[SECTION_TEXT].origin;
+
+	uint32_t offset = IMAGE_ALIGN;
+	for (s = sections; s < (sections + SECTION_COUNT); s++) {
+		uint32_t size = (secsize(s) + 3) & ~3;
+		if (size == 0) continue;
+		seg[hdr.segcount].addr = s->origin;
+		seg[hdr.segcount].offset = offset;
+		seg[hdr.segcount].filesz = secfilesz(s);
+		seg[hdr.segcount].memsz = size;
+		offset = (offset + secfilesz(s) + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+		segsec[hdr.segcount++] = s;
+	}
+
+	for (l = labels; l; l = l->next) {
+		hdr.symcount++;
+		hdr.strsize += strlen(l->name) + 1;
+	}
+	hdr.symoff = hdr.segcount ?
+		(seg[hdr.segcount - 1].offset + seg[hdr.segcount - 1].filesz) : IMAGE_ALIGN;
+
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fwrite(seg, sizeof(seg[0]), hdr.segcount, fp);
+	for (uint32_t n = 0; n < hdr.segcount; n++) {
+		fseek(fp, seg[n].offset, SEEK_SET);
+		fwrite(segsec[n]->data, seg[n].filesz, 1, fp);
+	}
+	fseek(fp, hdr.symoff, SEEK_SET);
+	uint32_t name = 0;
+	for (l = labels; l; l = l->next) {
+		sym.addr = l->pc;
+		sym.name = name;
+		name += strlen(l->name) + 1;
+		fwrite(&sym, sizeof(sym), 1, fp);
+	}
+	for (l = labels; l; l = l->next) {
+		fwrite(l->name, strlen(l->name) + 1, 1, fp);
+	}
+	if (fclose(fp)) die("error writing '%s'", fn);
+}
+
+void save_object(const char *fn) {
+	ObjectHeader hdr;
+	ObjectSymbol sym;
+	ObjectFixup fix;
+	struct label *l;
+	struct fixup *f;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = OBJECT_MAGIC;
+	hdr.version = OBJECT_VERSION;
+	for (unsigned n = 0; n < SECTION_COUNT; n++) {
+		hdr.size[n] = (secsize(sections + n) + 3) & ~3;
+	}
+
+	for (l = labels; l; l = l->next) {
+		l->index = hdr.symcount++;
+		hdr.strsize += strlen(l->name) + 1;
+		for (f = l->fixups; f; f = f->next) {
+			if (!resolvable(l, f)) hdr.fixcount++;
+		}
+	}
+
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	for (unsigned n = 0; n < SECTION_COUNT; n++) {
+		if (secfilesz(sections + n)) {
+			fwrite(sections[n].data, secfilesz(sections + n), 1, fp);
+		}
+	}
+	uint32_t name = 0;
+	for (l = labels; l; l = l->next) {
+		sym.value = l->pc;
+		sym.name = name;
+		sym.flags = (l->defined ? SYM_DEFINED : 0) |
+			(l->global ? SYM_GLOBAL : 0) | (l->abs ? SYM_ABS : 0);
+		sym.section = l->sec;
+		name += strlen(l->name) + 1;
+		fwrite(&sym, sizeof(sym), 1, fp);
+	}
+	for (l = labels; l; l = l->next) {
+		for (f = l->fixups; f; f = f->next) {
+			if (resolvable(l, f)) continue;
+			fix.section = f->sec;
+			fix.offset = f->pc;
+			fix.type = f->type;
+			fix.sym = l->index;
+			fwrite(&fix, sizeof(fix), 1, fp);
+		}
+	}
+	for (l = labels; l; l = l->next) {
+		fwrite(l->name, strlen(l->name) + 1, 1, fp);
+	}
+	if (fclose(fp)) die("error writing '%s'", fn);
 }
 
 enum tokens {
@@ -236,6 +677,7 @@ enum tokens {
 	tCOMMA, tCOLON, tOPAREN, tCPAREN, tAT, tDOT,
 	tADD, tSUB, tAND, tOR, tXOR, tSLL, tSRL, tSRA,
 	tSLT, tSLTU, tMUL, tDIV,
+	tAMOSWAP, tAMOADD, tAMOCAS,
 	tADDI, tSUBI, tANDI, tORI, tXORI, tSLLI, tSRLI, tSRAI,
 	tSLTI, tSLTUI, tMULI, tDIVI,
 	tJALR,
@@ -247,7 +689,8 @@ enum tokens {
 	tNOT, tNEG, tSEQZ, tSNEZ, tSLTZ, tSGTZ,
 	tBEQZ, tBNEZ, tBLEZ, tBGEZ, tBLTZ, tBGTZ,
 	tBGT, tBLE, tBGTU, tBLEU,
-	tEQU, tBYTE, tHALF, tWORD,
+	tEQU, tBYTE, tHALF, tWORD, tGLOBAL, tSPACE,
+	tTEXT, tRODATA, tDATA, tBSS,
 	NUMTOKENS,
 };
 
@@ -255,6 +698,7 @@ char *tnames[] = { "<EOF>", "<EOL>", "IDENT", "REGISTER", "NUMBER", "STRING",
 	",", ":", "(", ")", "@", ".",
 	"ADD", "SUB", "AND", "OR", "XOR", "SLL", "SRL", "SRA",
 	"SLT", "SLTU", "MUL", "DIV",
+	"AMOSWAP", "AMOADD", "AMOCAS",
 	"ADDI", "SUBI", "ANDI", "ORI", "XORI", "SLLI", "SRLI", "SRAI",
 	"SLTI", "SLTUI", "MULI", "DIVI",
 	"JALR",
@@ -267,7 +711,8 @@ char *tnames[] = { "<EOF>", "<EOL>", "IDENT", "REGISTER", "NUMBER", "STRING",
 	"NOT", "NEG", "SEQZ", "SNEZ", "SLTZ", "SGTZ",
 	"BEQZ", "BNEZ", "BLEZ", "BGEZ", "BLTZ", "BGTZ",
 	"BGT", "BLE", "BGTU", "BLEU",
-	".EQU", ".BYTE", ".HALF", ".WORD",
+	".EQU", ".BYTE", ".HALF", ".WORD", ".GLOBAL", ".SPACE",
+	".TEXT", ".RODATA", ".DATA", ".BSS",
 };
 
 static_assert(NUMTOKENS == (sizeof(tnames) / sizeof(tnames[0])),
@@ -481,7 +926,8 @@ void parse_memref(State *s, uint32_t *r, uint32_t *i) {
 void parse_rel(State *s, unsigned type, uint32_t *i) {
 	switch (s->tok) {
 	case tIDENT:
-		*i = uselabel(s->str, PC, type);
+		// the word(s) to fix up are emitted next, word aligned
+		*i = uselabel(s->str, (PC + 3) & ~3, type);
 		break;
 	case tDOT:
 		*i = -4;
@@ -517,7 +963,7 @@ int parse_line(State *s) {
 	char *name;
 	if (s->tok == tIDENT) {
 		name = strdup(s->str);
-		setlabel(name, PC);
+		setlabel(name, PC, 0);
 		if (next(s) != tCOLON) {
 			die("unexpected '%s'\n", name);
 		}
@@ -545,6 +991,12 @@ int parse_line(State *s) {
 		emit(ins_i(o, t, a, i));
 		break;
 	// todo: mul div
+	case tAMOSWAP: case tAMOADD: case tAMOCAS:
+		o = tok - tAMOSWAP + IR_AMOSWAP;
+		parse_2r_c(s, &t, &a);
+		parse_reg(s, &b);
+		emit(ins_r(o, t, a, b, 0));
+		break;
 	case tBEQ: case tBNE: case tBLT:
 	case tBLTU: case tBGE: case tBGEU:
 		o = tok - tBEQ;
@@ -689,6 +1141,8 @@ int parse_line(State *s) {
 		parse_r_c(s, &t);
 		if (s->tok == tIDENT) {
 			parse_rel(s, TYPE_ABS_HILO, &i);
+			emit(ins_l(L_LUI, t, 0, i >> 16));
+			emit(ins_i(IR_ADD, t, t, i & 0xFFFF));
 		} else {
 			parse_num(s, &i);
 			if (fits_in_signed16(i)) {
@@ -717,10 +1171,40 @@ int parse_line(State *s) {
 		emit(ins_j(J_JAL, 1, i));
 		break;
 	case tEQU:
-		require(s, tIDENT);
+		expect(s, tIDENT);
 		name = strdup(s->str);
+		next(s);
+		parse_num(s, &i);
+		setlabel(name, i, 1);
+		break;
+	case tTEXT: case tRODATA: case tDATA: case tBSS:
+		setsection(tok - tTEXT);
+		// optional origin
+		if (s->tok == tNUMBER) {
+			if (objmode) die("section origins are set by the linker");
+			if (sec->placed ? (sec->origin != s->num) : (PC != 0)) {
+				die("cannot move %s once assembled into", sec->name);
+			}
+			sec->origin = s->num;
+			sec->placed = 1;
+			next(s);
+		}
+		break;
+	case tSPACE:
 		parse_num(s, &i);
-		setlabel(name, i);
+		if ((PC + i) < PC) die("%s is too large", sec->name);
+		if (sec != (sections + SECTION_BSS)) {
+			secdata(sec, PC, i);
+		}
+		PC += i;
+		break;
+	case tGLOBAL:
+		for (;;) {
+			expect(s, tIDENT);
+			globallabel(s->str);
+			if (next(s) != tCOMMA) break;
+			next(s);
+		}
 		break;
 	case tWORD:
 		for (;;) {
@@ -782,23 +1266,61 @@ void assemble(const char *fn) {
 	while (parse_line(&state)) ;
 }
 
+int is_hex(const char *fn) {
+	size_t len = strlen(fn);
+	return (len > 4) && !strcmp(fn + len - 4, ".hex");
+}
+
+int is_raw(const char *fn) {
+	size_t len = strlen(fn);
+	return (len > 4) && !strcmp(fn + len - 4, ".bin");
+}
+
+int is_object(const char *fn) {
+	size_t len = strlen(fn);
+	return (len > 2) && !strcmp(fn + len - 2, ".o");
+}
+
 int main(int argc, char **argv) {
-	const char *outname = "out.hex";
-	filename = argv[1];
+	const char *outname = "out.img";
+	const char *lstname = NULL;
 
-	image_base = 0x100000;
-	image_size = sizeof(image);
-	PC = image_base;
+	while ((argc > 2) && (argv[1][0] == '-')) {
+		if (!strcmp(argv[1], "-l")) {
+			lstname = argv[2];
+		} else {
+			die("unknown option '%s'", argv[1]);
+		}
+		argc -= 2;
+		argv += 2;
+	}
+	filename = argv[1];
 
 	if (argc < 2) {
-		die("no file specified");
+		die("usage: asm [ -l <listing> ] <file.s> [ <out.img> | <out.hex> | <out.bin> | <out.o> ]");
 	}
 	if (argc == 3) {
 		outname = argv[2];
 	}
 
+	// objects are assembled at 0 and placed by the linker
+	objmode = is_object(outname);
+
 	assemble(filename);
 	checklabels();
-	save(outname);
+	resolve();
+	// .hex outputs remain the text listing format
+	if (is_hex(outname)) {
+		save(outname);
+	} else if (is_raw(outname)) {
+		save_raw(outname);
+	} else if (objmode) {
+		save_object(outname);
+	} else {
+		save_image(outname);
+	}
+	if (lstname) {
+		save(lstname);
+	}
 	return 0;
 }
@@ -0,0 +1,30 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Ahead-of-time translated code engine (-e aot)
+//
+// bin/aot translates an image to C defining sr32aot_run(), which
+// the Makefile links into its own copy of the emulator (bin/emu-%).
+// That runs translated code until it reaches something it did not
+// translate, which is interpreted a block at a time with predecode.
+// Emulators built without a translation fall back to predecode.
+
+#include <stdio.h>
+
+#include <emulator-sr32.h>
+
+void sr32aot_run(CpuState *s) __attribute__((weak));
+
+void sr32core_aot(CpuState *s) {
+	if (sr32aot_run == NULL) {
+		fprintf(stderr, "emu: no aot translation linked, using predecode\n");
+		sr32core_predecode(s);
+		return;
+	}
+	for (;;) {
+		sr32aot_run(s);
+		if (sr32block_predecode(s)) {
+			return;
+		}
+	}
+}
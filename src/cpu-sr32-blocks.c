@@ -0,0 +1,396 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Basic block cache execution engine
+//
+// Straight-line runs of guest code ending at a branch, jal, jalr,
+// syscall, or undefined instruction are decoded once into a Block
+// of DecodedIns records and cached by pc.  Each block remembers
+// its fallthrough and taken successors, so execution only returns
+// to the hash lookup for jalr targets, blocks not yet discovered,
+// and blocks invalidated by stores.
+//
+// Blocks never cross a page boundary (ending early with PD_EXIT
+// if need be).  As with the jit, a per-word bitmap of cached code
+// lets blocks_invalidate() drop exactly the overwritten blocks, and
+// a store that does so ends the running block.
+//
+// Within a block, each handler dispatches directly to the next
+// record's handler (computed goto).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emulator-sr32.h>
+#include <sr32.h>
+
+#define BLK_MAX_INS    64
+#define BLK_MAX_BLOCKS 65536
+#define BLK_POOL       (BLK_MAX_BLOCKS * 16)
+#define BLK_HASH_SIZE  16384
+
+typedef struct Block Block;
+struct Block {
+	Block *hnext;		// hash chain
+	Block *pnext;		// blocks on the same page
+	Block *next[2];		// successors: fallthrough, taken
+	DecodedIns *ins;
+	uint32_t pc;
+	uint32_t start;		// RAM offset of first word
+	uint32_t end;		// RAM offset past last word
+	uint32_t len;		// instructions, excluding PD_EXIT
+	uint32_t valid;
+	uint64_t execs;
+};
+
+static Block blk_blocks[BLK_MAX_BLOCKS];
+static uint32_t blk_nblocks;
+static DecodedIns blk_ins[BLK_POOL];
+static uint32_t blk_nins;
+static Block *blk_hash[BLK_HASH_SIZE];
+static Block **blk_pages;	// per guest page
+static uint32_t *blk_words;	// per guest word bitmap
+static uint32_t blk_gen;
+static int blk_hit;
+
+static void blk_mark(Block *b) {
+	for (uint32_t w = b->start >> 2; w < (b->end >> 2); w++) {
+		blk_words[w >> 5] |= 1U << (w & 31);
+	}
+}
+
+static void blk_flush(void) {
+	memset(blk_hash, 0, sizeof(blk_hash));
+	emu_clear(blk_pages, sizeof(Block*) * (emu_ram_size / PAGESIZE));
+	emu_clear(blk_words, emu_ram_size / 32);
+	for (uint32_t n = 0; n < (emu_ram_size / PAGESIZE); n++) {
+		emu_codepage[n] &= ~CODE_BLOCKS;
+	}
+	blk_nblocks = 0;
+	blk_nins = 0;
+	blk_gen++;
+}
+
+static int blk_terminal(uint32_t op) {
+	switch (op) {
+	case PD_JALRI: case PD_JALR:
+	case PD_BEQ: case PD_BNE: case PD_BLT:
+	case PD_BLTU: case PD_BGE: case PD_BGEU:
+	case PD_JAL: case PD_SYSCALL: case PD_UNDEF:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static Block *blk_create(uint32_t pc, Block **bucket) {
+	if ((blk_nblocks == BLK_MAX_BLOCKS) ||
+		((blk_nins + BLK_MAX_INS + 1) > BLK_POOL)) {
+		blk_flush();
+	}
+	Block *b = blk_blocks + blk_nblocks++;
+	memset(b, 0, sizeof(*b));
+	b->ins = blk_ins + blk_nins;
+	b->pc = pc;
+
+	uint32_t addr = pc;
+	for (;;) {
+		DecodedIns *d = b->ins + b->len++;
+		sr32decode(mem_rd32(addr), d);
+		addr += 4;
+		if (blk_terminal(d->op)) break;
+		if (((addr & (PAGESIZE - 1)) == 0) || (b->len == BLK_MAX_INS)) {
+			b->ins[b->len].op = PD_EXIT;
+			blk_nins++;
+			break;
+		}
+	}
+	blk_nins += b->len;
+
+	b->start = pc & emu_mask32;
+	b->end = b->start + b->len * 4;
+	b->pnext = blk_pages[b->start >> PAGESHIFT];
+	blk_pages[b->start >> PAGESHIFT] = b;
+	emu_codepage[b->start >> PAGESHIFT] |= CODE_BLOCKS;
+	blk_mark(b);
+
+	b->valid = 1;
+	b->hnext = *bucket;
+	*bucket = b;
+	return b;
+}
+
+static Block *blk_lookup(uint32_t pc) {
+	Block **bucket = blk_hash + ((pc >> 2) & (BLK_HASH_SIZE - 1));
+	for (Block *b = *bucket; b; b = b->hnext) {
+		if (b->pc == pc) return b;
+	}
+	return blk_create(pc, bucket);
+}
+
+void blocks_invalidate(uint32_t addr) {
+	uint32_t w = addr >> 2;
+	if (!(blk_words[w >> 5] & (1U << (w & 31)))) {
+		return;
+	}
+	uint32_t page = addr >> PAGESHIFT;
+	Block **pp = blk_pages + page;
+	Block *b;
+	while ((b = *pp) != NULL) {
+		if ((addr >= b->start) && (addr < b->end)) {
+			*pp = b->pnext;
+			Block **hp = blk_hash + ((b->pc >> 2) & (BLK_HASH_SIZE - 1));
+			while (*hp != b) hp = &(*hp)->hnext;
+			*hp = b->hnext;
+			b->valid = 0;
+			blk_hit = 1;
+		} else {
+			pp = &b->pnext;
+		}
+	}
+	memset(blk_words + (page << (PAGESHIFT - 7)), 0, PAGESIZE / 32);
+	for (b = blk_pages[page]; b; b = b->pnext) {
+		blk_mark(b);
+	}
+}
+
+static int blk_cmp(const void *_a, const void *_b) {
+	const Block *a = *((const Block**) _a);
+	const Block *b = *((const Block**) _b);
+	uint64_t na = a->execs * a->len;
+	uint64_t nb = b->execs * b->len;
+	return (na < nb) ? 1 : ((na > nb) ? -1 : 0);
+}
+
+void blocks_stats(void) {
+	Block **list = malloc(sizeof(Block*) * (blk_nblocks + 1));
+	uint64_t total = 0;
+	uint32_t count = 0;
+	for (uint32_t n = 0; n < blk_nblocks; n++) {
+		Block *b = blk_blocks + n;
+		if (b->execs) {
+			list[count++] = b;
+			total += b->execs * b->len;
+		}
+	}
+	qsort(list, count, sizeof(Block*), blk_cmp);
+	fprintf(stderr, "blocks: %u executed, %u cached, ~%llu instructions\n",
+		count, blk_nblocks, (unsigned long long) total);
+	fprintf(stderr, "   block len        execs        insns      %%\n");
+	for (uint32_t n = 0; (n < count) && (n < 32); n++) {
+		Block *b = list[n];
+		uint64_t insns = b->execs * b->len;
+		fprintf(stderr, "%08x %3u %12llu %12llu %6.2f%s\n",
+			b->pc, b->len, (unsigned long long) b->execs,
+			(unsigned long long) insns, (100.0 * insns) / total,
+			b->valid ? "" : " (stale)");
+	}
+	free(list);
+}
+
+#define PC_AT(d) (b->pc + ((uint32_t) ((d) - b->ins)) * 4)
+#define NEXT() goto *optab[(++d)->op]
+
+// With oneblock set, execution stops at the end of the first block
+// with s->pc at its successor, as for sr32block_predecode().
+static int blk_exec(CpuState *s, int oneblock) {
+	static const void *optab[] = {
+		[PD_DECODE] = &&op_undef,
+		[PD_UNDEF] = &&op_undef,
+		[PD_NOP] = &&op_nop,
+		[PD_ADDI] = &&op_addi,
+		[PD_SUBI] = &&op_subi,
+		[PD_ANDI] = &&op_andi,
+		[PD_ORI] = &&op_ori,
+		[PD_XORI] = &&op_xori,
+		[PD_SLLI] = &&op_slli,
+		[PD_SRLI] = &&op_srli,
+		[PD_SRAI] = &&op_srai,
+		[PD_SLTI] = &&op_slti,
+		[PD_SLTUI] = &&op_sltui,
+		[PD_MULI] = &&op_muli,
+		[PD_DIVI] = &&op_divi,
+		[PD_JALRI] = &&op_jalri,
+		[PD_ADD] = &&op_add,
+		[PD_SUB] = &&op_sub,
+		[PD_AND] = &&op_and,
+		[PD_OR] = &&op_or,
+		[PD_XOR] = &&op_xor,
+		[PD_SLL] = &&op_sll,
+		[PD_SRL] = &&op_srl,
+		[PD_SRA] = &&op_sra,
+		[PD_SLT] = &&op_slt,
+		[PD_SLTU] = &&op_sltu,
+		[PD_MUL] = &&op_mul,
+		[PD_DIV] = &&op_div,
+		[PD_JALR] = &&op_jalr,
+		[PD_AMOSWAP] = &&op_amo,
+		[PD_AMOADD] = &&op_amo,
+		[PD_AMOCAS] = &&op_amo,
+		[PD_LDW] = &&op_ldw,
+		[PD_LDH] = &&op_ldh,
+		[PD_LDB] = &&op_ldb,
+		[PD_LDX] = &&op_ldx,
+		[PD_LI] = &&op_li,
+		[PD_LDHU] = &&op_ldhu,
+		[PD_LDBU] = &&op_ldbu,
+		[PD_AUIPC] = &&op_auipc,
+		[PD_STW] = &&op_stw,
+		[PD_STH] = &&op_sth,
+		[PD_STB] = &&op_stb,
+		[PD_STX] = &&op_stx,
+		[PD_BEQ] = &&op_beq,
+		[PD_BNE] = &&op_bne,
+		[PD_BLT] = &&op_blt,
+		[PD_BLTU] = &&op_bltu,
+		[PD_BGE] = &&op_bge,
+		[PD_BGEU] = &&op_bgeu,
+		[PD_JAL] = &&op_jal,
+		[PD_SYSCALL] = &&op_syscall,
+		[PD_EXIT] = &&op_exit,
+	};
+	int32_t *r = s->r;
+	if (blk_pages == NULL) {
+		blk_pages = emu_alloc(sizeof(Block*) * (emu_ram_size / PAGESIZE));
+		blk_words = emu_alloc(emu_ram_size / 32);
+	}
+	Block *b = blk_lookup(s->pc);
+	Block *n;
+	DecodedIns *d;
+	uint32_t pc, k;
+	uint32_t start;		// first instruction not yet counted
+	int32_t x;
+
+	for (;;) {
+	b->execs++;
+	d = b->ins;
+	start = b->pc;
+	goto *optab[d->op];
+	op_nop: NEXT();
+	op_addi: r[d->t] = r[d->a] + d->i; NEXT();
+	op_subi: r[d->t] = r[d->a] - d->i; NEXT();
+	op_andi: r[d->t] = r[d->a] & d->i; NEXT();
+	op_ori: r[d->t] = r[d->a] | d->i; NEXT();
+	op_xori: r[d->t] = r[d->a] ^ d->i; NEXT();
+	op_slli: r[d->t] = r[d->a] << d->i; NEXT();
+	op_srli: r[d->t] = ((uint32_t)r[d->a]) >> d->i; NEXT();
+	op_srai: r[d->t] = r[d->a] >> d->i; NEXT();
+	op_slti: r[d->t] = (r[d->a] < d->i) ? 1 : 0; NEXT();
+	op_sltui: r[d->t] = (((uint32_t)r[d->a]) < ((uint32_t)d->i)) ? 1 : 0; NEXT();
+	op_muli: r[d->t] = r[d->a] * d->i; NEXT();
+	op_divi: x = r[d->a] / d->i; if (d->t) r[d->t] = x; NEXT();
+	op_jalri: pc = r[d->a] + d->i; goto jalr;
+	op_add: r[d->t] = r[d->a] + r[d->b]; NEXT();
+	op_sub: r[d->t] = r[d->a] - r[d->b]; NEXT();
+	op_and: r[d->t] = r[d->a] & r[d->b]; NEXT();
+	op_or: r[d->t] = r[d->a] | r[d->b]; NEXT();
+	op_xor: r[d->t] = r[d->a] ^ r[d->b]; NEXT();
+	op_sll: r[d->t] = r[d->a] << (r[d->b] & 31); NEXT();
+	op_srl: r[d->t] = ((uint32_t)r[d->a]) >> (r[d->b] & 31); NEXT();
+	op_sra: r[d->t] = r[d->a] >> (r[d->b] & 31); NEXT();
+	op_slt: r[d->t] = (r[d->a] < r[d->b]) ? 1 : 0; NEXT();
+	op_sltu: r[d->t] = (((uint32_t)r[d->a]) < ((uint32_t)r[d->b])) ? 1 : 0; NEXT();
+	op_mul: r[d->t] = r[d->a] * r[d->b]; NEXT();
+	op_div: x = r[d->a] / r[d->b]; if (d->t) r[d->t] = x; NEXT();
+	op_jalr: pc = r[d->a] + r[d->b]; goto jalr;
+	op_amo:
+		x = mem_amo32(d->op - PD_AMOSWAP + IR_AMOSWAP, r[d->a], r[d->t], r[d->b]);
+		if (d->t) r[d->t] = x;
+		if (blk_hit) goto stale;
+		NEXT();
+	op_ldw: r[d->t] = mem_rd32(r[d->a] + d->i); NEXT();
+	op_ldh: r[d->t] = (int16_t) mem_rd16(r[d->a] + d->i); NEXT();
+	op_ldb: r[d->t] = (int8_t) mem_rd8(r[d->a] + d->i); NEXT();
+	op_ldx:
+		pc = PC_AT(d) + 4;
+		s->pc = pc;
+		sched_count(s, start, pc);
+		start = pc;
+		x = io_rd32(s, r[d->a] + d->i);
+		if (d->t) r[d->t] = x;
+		NEXT();
+	op_li: r[d->t] = d->i; NEXT();
+	op_ldhu: r[d->t] = mem_rd16(r[d->a] + d->i); NEXT();
+	op_ldbu: r[d->t] = mem_rd8(r[d->a] + d->i); NEXT();
+	op_auipc: r[d->t] = PC_AT(d) + 4 + d->i; NEXT();
+	op_stw: mem_wr32(r[d->a] + d->i, r[d->t]); if (blk_hit) goto stale; NEXT();
+	op_sth: mem_wr16(r[d->a] + d->i, r[d->t]); if (blk_hit) goto stale; NEXT();
+	op_stb: mem_wr8(r[d->a] + d->i, r[d->t]); if (blk_hit) goto stale; NEXT();
+	op_stx:
+		pc = PC_AT(d) + 4;
+		s->pc = pc;
+		sched_count(s, start, pc);
+		start = pc;
+		io_wr32(s, r[d->a] + d->i, r[d->t]);
+		if (blk_hit) goto stale;
+		NEXT();
+	op_beq: k = (r[d->a] == r[d->t]); goto branch;
+	op_bne: k = (r[d->a] != r[d->t]); goto branch;
+	op_blt: k = (r[d->a] < r[d->t]); goto branch;
+	op_bltu: k = (((uint32_t)r[d->a]) < ((uint32_t)r[d->t])); goto branch;
+	op_bge: k = (r[d->a] >= r[d->t]); goto branch;
+	op_bgeu: k = (((uint32_t)r[d->a]) >= ((uint32_t)r[d->t])); goto branch;
+	op_jal:
+		pc = PC_AT(d) + 4;
+		if (d->t) r[d->t] = pc;
+		sched_block(s, start, pc);
+		pc += d->i;
+		k = 1;
+		goto chain;
+	op_syscall:
+		pc = PC_AT(d) + 4;
+		s->pc = pc;
+		sched_block(s, start, pc);
+		do_syscall(s, d->i);
+		k = 0;
+		goto chain;
+	op_exit:
+		pc = PC_AT(d);
+		sched_block(s, start, pc);
+		k = 0;
+		goto chain;
+	op_undef:
+		s->pc = PC_AT(d) + 4;
+		do_undef(s, mem_rd32(PC_AT(d)));
+		return -1;
+branch:
+	pc = PC_AT(d) + 4;
+	sched_block(s, start, pc);
+	if (k) pc += d->i;
+chain:
+	if (oneblock) break;
+	n = b->next[k];
+	if ((n == NULL) || !n->valid) {
+		uint32_t gen = blk_gen;
+		n = blk_lookup(pc);
+		if (gen == blk_gen) b->next[k] = n;
+	}
+	b = n;
+	continue;
+jalr:
+	x = PC_AT(d) + 4;
+	if (d->t) r[d->t] = x;
+	sched_block(s, start, x);
+	if (oneblock) break;
+	b = blk_lookup(pc);
+	continue;
+stale:
+	// a store overwrote cached code, possibly this block
+	blk_hit = 0;
+	pc = PC_AT(d) + 4;
+	sched_block(s, start, pc);
+	if (oneblock) break;
+	b = blk_lookup(pc);
+	}
+	s->pc = pc;
+	return 0;
+}
+
+void sr32core_blocks(CpuState *s) {
+	blk_exec(s, 0);
+}
+
+int sr32block_blocks(CpuState *s) {
+	return blk_exec(s, 1);
+}
@@ -0,0 +1,776 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Dynamic binary translator (x86-64 hosts)
+//
+// Blocks start out interpreted by sr32block_predecode().  Once a
+// block has been entered JIT_HOT times it is translated to host
+// code in an executable cache.  Up to eight of the guest registers
+// a block uses most live in host registers for its duration and
+// are written back to CpuState at each exit.  Guest RAM accesses
+// are inlined; stores to pages flagged in emu_codepage[], atomics,
+// ldx, stx, and syscall call back into C.
+//
+// Translations never cross a page boundary.  A bitmap of the words
+// covered by translations lets jit_invalidate() reset exactly the
+// blocks a store overwrote, after which the storing block exits so
+// the stale remainder of it does not run.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <emulator-sr32.h>
+#include <sr32.h>
+
+#if defined(__x86_64__)
+
+#define JIT_HOT        16
+#define JIT_MAX_INS    128
+#define JIT_MAX_CODE   (64*1024)
+#define JIT_CACHE_SIZE (32*1024*1024)
+#define JIT_MAX_BLOCKS 65536
+#define JIT_HASH_SIZE  16384
+
+typedef struct JitBlock JitBlock;
+struct JitBlock {
+	JitBlock *hnext;	// hash chain
+	JitBlock *pnext;	// translations on the same page
+	uint32_t (*code)(CpuState *s);
+	uint32_t pc;
+	uint32_t start;		// RAM offset of first word
+	uint32_t end;		// RAM offset past last word
+	uint32_t count;		// entries while interpreted
+	uint32_t nojit;		// first instruction is untranslatable
+};
+
+static uint8_t *jit_cache;
+static uint8_t *jit_next;
+static JitBlock jit_blocks[JIT_MAX_BLOCKS];
+static uint32_t jit_nblocks;
+static JitBlock *jit_hash[JIT_HASH_SIZE];
+static JitBlock **jit_pages;	// per guest page
+static uint32_t *jit_words;	// per guest word bitmap
+static int jit_hit;
+
+// ---- x86-64 encoder ----
+
+enum {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+#define RSTATE R15	// CpuState *s
+#define RRAM   R14	// emu_ram
+
+#define CC_B  0x2
+#define CC_AE 0x3
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_L  0xC
+#define CC_GE 0xD
+
+static uint8_t *cp;
+
+static void e8(uint32_t x) {
+	*cp++ = x;
+}
+static void e32(uint32_t x) {
+	memcpy(cp, &x, 4);
+	cp += 4;
+}
+static void e64(uint64_t x) {
+	memcpy(cp, &x, 8);
+	cp += 8;
+}
+
+static void rex(int w, int reg, int index, int base) {
+	uint32_t x = 0x40 | (w << 3) | ((reg & 8) >> 1) |
+		((index & 8) >> 2) | ((base & 8) >> 3);
+	if (x != 0x40) e8(x);
+}
+
+// opcodes above 0xFF are two byte 0x0F-prefixed opcodes
+static void opc(uint32_t op) {
+	if (op > 0xFF) e8(op >> 8);
+	e8(op);
+}
+
+// op reg, rm
+static void x_rr(uint32_t op, int reg, int rm) {
+	rex(0, reg, 0, rm);
+	opc(op);
+	e8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// 64bit mov rm, reg
+static void x_mov64(int rm, int reg) {
+	rex(1, reg, 0, rm);
+	e8(0x89);
+	e8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op reg, [base + disp]
+static void x_rm(uint32_t op, int reg, int base, int32_t disp) {
+	uint32_t mod;
+	rex(0, reg, 0, base);
+	opc(op);
+	if ((disp == 0) && ((base & 7) != RBP)) {
+		mod = 0x00;
+	} else if ((disp >= -128) && (disp < 128)) {
+		mod = 0x40;
+	} else {
+		mod = 0x80;
+	}
+	e8(mod | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == RSP) e8(0x24);
+	if (mod == 0x40) e8(disp);
+	if (mod == 0x80) e32(disp);
+}
+
+// op reg, [base + index]
+static void x_rsib(uint32_t op, int reg, int base, int index) {
+	rex(0, reg, index, base);
+	opc(op);
+	if ((base & 7) == RBP) {
+		e8(0x44 | ((reg & 7) << 3));
+		e8(((index & 7) << 3) | (base & 7));
+		e8(0);
+	} else {
+		e8(0x04 | ((reg & 7) << 3));
+		e8(((index & 7) << 3) | (base & 7));
+	}
+}
+
+// group-1 alu op (ext) rm, imm
+static void x_ri(uint32_t ext, int rm, int32_t imm) {
+	rex(0, 0, 0, rm);
+	if (imm == (int8_t) imm) {
+		e8(0x83);
+		e8(0xC0 | (ext << 3) | (rm & 7));
+		e8(imm);
+	} else {
+		e8(0x81);
+		e8(0xC0 | (ext << 3) | (rm & 7));
+		e32(imm);
+	}
+}
+
+// does not modify flags
+static void x_movi(int r, uint32_t imm) {
+	rex(0, 0, 0, r);
+	e8(0xB8 + (r & 7));
+	e32(imm);
+}
+
+static void x_movi64(int r, const void *p) {
+	rex(1, 0, 0, r);
+	e8(0xB8 + (r & 7));
+	e64((uintptr_t) p);
+}
+
+static void x_call(const void *fn) {
+	x_movi64(RAX, fn);
+	e8(0xFF);
+	e8(0xD0);
+}
+
+static uint8_t *x_jcc(uint32_t cc) {
+	e8(0x0F);
+	e8(0x80 | cc);
+	e32(0);
+	return cp;
+}
+
+static uint8_t *x_jmp(void) {
+	e8(0xE9);
+	e32(0);
+	return cp;
+}
+
+// point the jump ending at 'from' to the current location
+static void x_patch(uint8_t *from) {
+	int32_t rel = cp - from;
+	memcpy(from - 4, &rel, 4);
+}
+
+static const int8_t saved[6] = { RBX, RBP, R12, R13, R14, R15 };
+
+static void x_push(int r) {
+	if (r & 8) e8(0x41);
+	e8(0x50 | (r & 7));
+}
+
+static void x_pop(int r) {
+	if (r & 8) e8(0x41);
+	e8(0x58 | (r & 7));
+}
+
+static void x_epilogue(void) {
+	e8(0x48); e8(0x83); e8(0xC4); e8(0x08); // add rsp, 8
+	for (int n = 5; n >= 0; n--) x_pop(saved[n]);
+	e8(0xC3);
+}
+
+// ---- guest register mapping ----
+
+// host registers available to hold guest registers
+static const int8_t allocatable[8] = { RBX, RBP, R12, R13, R8, R9, R10, R11 };
+
+static int8_t hreg[32];		// host register for guest register or -1
+static uint32_t dirty;		// guest registers modified in host registers
+
+#define GOFF(g) ((int32_t) (offsetof(CpuState, r) + (g) * 4))
+
+static void g_load(int host, uint32_t g) {
+	if (hreg[g] >= 0) {
+		x_rr(0x89, hreg[g], host);
+	} else {
+		x_rm(0x8B, host, RSTATE, GOFF(g));
+	}
+}
+
+// host = host op Rg, where op is an "op reg, r/m" opcode
+static void g_op(uint32_t op, int host, uint32_t g) {
+	if (hreg[g] >= 0) {
+		x_rr(op, host, hreg[g]);
+	} else {
+		x_rm(op, host, RSTATE, GOFF(g));
+	}
+}
+
+static void g_store(uint32_t g, int host) {
+	if (g == 0) return;
+	if (hreg[g] >= 0) {
+		x_rr(0x89, host, hreg[g]);
+		dirty |= 1U << g;
+	} else {
+		x_rm(0x89, host, RSTATE, GOFF(g));
+	}
+}
+
+static void g_storei(uint32_t g, uint32_t imm) {
+	if (g == 0) return;
+	if (hreg[g] >= 0) {
+		x_movi(hreg[g], imm);
+		dirty |= 1U << g;
+	} else {
+		x_rm(0xC7, 0, RSTATE, GOFF(g));
+		e32(imm);
+	}
+}
+
+static void g_writeback(void) {
+	for (uint32_t g = 1; g < 32; g++) {
+		if (dirty & (1U << g)) {
+			x_rm(0x89, hreg[g], RSTATE, GOFF(g));
+		}
+	}
+}
+
+// caller-saved host registers do not survive helper calls, and
+// io and syscall helpers may modify CpuState, so reload after them
+static void g_reload(int all) {
+	for (uint32_t g = 1; g < 32; g++) {
+		if ((hreg[g] >= 0) && (all || (hreg[g] >= R8 && hreg[g] <= R11))) {
+			x_rm(0x8B, hreg[g], RSTATE, GOFF(g));
+		}
+	}
+}
+
+// instructions retired by the block are counted down in
+// s->countdown before each ldx, stx, and syscall and at each exit
+static uint32_t jit_counted;	// first instruction not yet counted
+
+static void x_count(uint32_t next, int commit) {
+	uint32_t n = (next - jit_counted) >> 2;
+	if (n > 127) {
+		x_rm(0x81, 5, RSTATE, offsetof(CpuState, countdown));
+		e32(n);
+	} else if (n) {
+		x_rm(0x83, 5, RSTATE, offsetof(CpuState, countdown));
+		e8(n);
+	}
+	if (commit) jit_counted = next;
+}
+
+static void x_exit(uint32_t pc) {
+	g_writeback();
+	x_movi(RAX, pc);
+	x_epilogue();
+}
+
+// ---- translation ----
+
+static uint32_t jit_wr32(uint32_t addr, uint32_t val) {
+	jit_hit = 0;
+	mem_wr32(addr, val);
+	return jit_hit;
+}
+static uint32_t jit_wr16(uint32_t addr, uint32_t val) {
+	jit_hit = 0;
+	mem_wr16(addr, val);
+	return jit_hit;
+}
+static uint32_t jit_wr8(uint32_t addr, uint32_t val) {
+	jit_hit = 0;
+	mem_wr8(addr, val);
+	return jit_hit;
+}
+
+static uint32_t jit_amo(CpuState *s, uint32_t ins) {
+	uint32_t t = get_rt(ins);
+	jit_hit = 0;
+	uint32_t n = mem_amo32(ins & 15, s->r[get_ra(ins)], s->r[t], s->r[get_rb(ins)]);
+	if (t) s->r[t] = n;
+	return jit_hit;
+}
+
+#define JK_NORMAL 0
+#define JK_END    1
+#define JK_UNDEF  2
+
+static int jit_kind(uint32_t ins) {
+	switch ((ins >> 3) & 7) {
+	case 0b000: case 0b001: case 0b010: case 0b011:
+		switch (ins & 15) {
+		case 0xc: case 0xd: case 0xe:
+			return (ins & 0x10) ? JK_NORMAL : JK_UNDEF;
+		case 0xf: return JK_END;
+		default: return JK_NORMAL;
+		}
+	case 0b100: return JK_NORMAL;
+	case 0b101: return ((ins & 7) > S_STX) ? JK_UNDEF : JK_NORMAL;
+	case 0b110: return ((ins & 7) > B_BGEU) ? JK_UNDEF : JK_END;
+	default: return ((ins & 7) > J_SYSCALL) ? JK_UNDEF : JK_END;
+	}
+}
+
+// alu ops by IR_* index: "op reg, r/m" opcode and group-1 extension
+static const uint16_t alu_rm[5] = { 0x03, 0x2B, 0x23, 0x0B, 0x33 };
+static const uint8_t alu_ext[5] = { 0, 5, 4, 1, 6 };
+// shift group-2 extensions for IR_SLL, IR_SRL, IR_SRA
+static const uint8_t sh_ext[3] = { 4, 5, 7 };
+static const uint8_t br_cc[6] = { CC_E, CC_NE, CC_L, CC_B, CC_GE, CC_AE };
+
+static void jit_store(uint32_t op, uint32_t next) {
+	static const void *slow[3] = { jit_wr32, jit_wr16, jit_wr8 };
+	// edx = page of eax, then test emu_codepage[edx]
+	x_rr(0x89, RAX, RDX);
+	x_rr(0xC1, 5, RDX);
+	e8(PAGESHIFT);
+	x_movi64(RSI, emu_codepage);
+	x_rsib(0xF6, 0, RSI, RDX);
+	e8(0xFF);
+	uint8_t *to_slow = x_jcc(CC_NE);
+	switch (op) {
+	case S_STW: x_rsib(0x89, RCX, RRAM, RAX); break;
+	case S_STH: e8(0x66); x_rsib(0x89, RCX, RRAM, RAX); break;
+	case S_STB: x_rsib(0x88, RCX, RRAM, RAX); break;
+	}
+	uint8_t *to_done = x_jmp();
+	x_patch(to_slow);
+	g_writeback();
+	x_rr(0x89, RAX, RDI);
+	x_rr(0x89, RCX, RSI);
+	x_call(slow[op]);
+	g_reload(0);
+	// a translation was overwritten: leave before running stale code
+	x_rr(0x85, RAX, RAX);
+	uint8_t *to_cont = x_jcc(CC_E);
+	x_count(next, 0);
+	x_movi(RAX, next);
+	x_epilogue();
+	x_patch(to_cont);
+	x_patch(to_done);
+}
+
+static void jit_ins(uint32_t pc, uint32_t ins) {
+	const uint32_t mask[3] = { emu_mask32, emu_mask16, emu_mask8 };
+	uint32_t t = get_rt(ins);
+	uint32_t a = get_ra(ins);
+	uint32_t b = get_rb(ins);
+	int32_t i = get_i16(ins);
+	uint32_t next = pc + 4;
+	uint32_t op;
+
+	switch ((ins >> 3) & 7) {
+	case 0b000: case 0b001: case 0b010: case 0b011: { // I/R
+		uint32_t reg = ins & 0x10;
+		op = ins & 15;
+		if (op == IR_JALR) {
+			g_load(RAX, a);
+			if (reg) {
+				g_op(0x03, RAX, b);
+			} else if (i) {
+				x_ri(0, RAX, i);
+			}
+			g_storei(t, next);
+			g_writeback();
+			x_count(next, 1);
+			x_epilogue();
+			break;
+		}
+		if ((op >= IR_AMOSWAP) && (op <= IR_AMOCAS)) {
+			// atomics run in C against CpuState
+			g_writeback();
+			dirty = 0;
+			x_mov64(RDI, RSTATE);
+			x_movi(RSI, ins);
+			x_call(jit_amo);
+			g_reload(1);
+			x_rr(0x85, RAX, RAX);
+			uint8_t *to_cont = x_jcc(CC_E);
+			x_count(next, 0);
+			x_movi(RAX, next);
+			x_epilogue();
+			x_patch(to_cont);
+			break;
+		}
+		// divide may trap, everything else is dead if t is r0
+		if ((t == 0) && (op != IR_DIV)) break;
+		g_load(RAX, a);
+		switch (op) {
+		case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_XOR:
+			if (reg) {
+				g_op(alu_rm[op], RAX, b);
+			} else {
+				x_ri(alu_ext[op], RAX, i);
+			}
+			break;
+		case IR_SLL: case IR_SRL: case IR_SRA:
+			if (reg) {
+				g_load(RCX, b);
+				x_rr(0xD3, sh_ext[op - IR_SLL], RAX);
+			} else {
+				x_rr(0xC1, sh_ext[op - IR_SLL], RAX);
+				e8(i & 31);
+			}
+			break;
+		case IR_SLT: case IR_SLTU:
+			if (reg) {
+				g_op(0x3B, RAX, b);
+			} else {
+				x_ri(7, RAX, i);
+			}
+			x_rr(0x0F90 | ((op == IR_SLT) ? CC_L : CC_B), 0, RAX);
+			x_rr(0x0FB6, RAX, RAX);
+			break;
+		case IR_MUL:
+			if (reg) {
+				g_op(0x0FAF, RAX, b);
+			} else {
+				x_rr(0x69, RAX, RAX);
+				e32(i);
+			}
+			break;
+		case IR_DIV:
+			if (reg) {
+				g_load(RCX, b);
+			} else {
+				x_movi(RCX, i);
+			}
+			e8(0x99); // cdq
+			x_rr(0xF7, 7, RCX);
+			break;
+		}
+		g_store(t, RAX);
+		break;
+	}
+	case 0b100: // L
+		op = ins & 7;
+		if (op == L_LDX) {
+			g_writeback();
+			dirty = 0;
+			x_rm(0xC7, 0, RSTATE, offsetof(CpuState, pc));
+			e32(next);
+			x_count(next, 1);
+			g_load(RSI, a);
+			if (i) x_ri(0, RSI, i);
+			x_mov64(RDI, RSTATE);
+			x_call(io_rd32);
+			g_reload(1);
+			g_store(t, RAX);
+			break;
+		}
+		if (t == 0) break;
+		if (op == L_LUI) {
+			g_storei(t, ins & 0xFFFF0000);
+			break;
+		}
+		if (op == L_AUIPC) {
+			g_storei(t, next + (ins & 0xFFFF0000));
+			break;
+		}
+		g_load(RAX, a);
+		if (i) x_ri(0, RAX, i);
+		switch (op) {
+		case L_LDW:
+			x_ri(4, RAX, emu_mask32);
+			x_rsib(0x8B, RAX, RRAM, RAX);
+			break;
+		case L_LDH:
+			x_ri(4, RAX, emu_mask16);
+			x_rsib(0x0FBF, RAX, RRAM, RAX);
+			break;
+		case L_LDHU:
+			x_ri(4, RAX, emu_mask16);
+			x_rsib(0x0FB7, RAX, RRAM, RAX);
+			break;
+		case L_LDB:
+			x_ri(4, RAX, emu_mask8);
+			x_rsib(0x0FBE, RAX, RRAM, RAX);
+			break;
+		case L_LDBU:
+			x_ri(4, RAX, emu_mask8);
+			x_rsib(0x0FB6, RAX, RRAM, RAX);
+			break;
+		}
+		g_store(t, RAX);
+		break;
+	case 0b101: // S
+		op = ins & 7;
+		if (op == S_STX) {
+			g_writeback();
+			dirty = 0;
+			x_rm(0xC7, 0, RSTATE, offsetof(CpuState, pc));
+			e32(next);
+			x_count(next, 1);
+			g_load(RSI, a);
+			if (i) x_ri(0, RSI, i);
+			g_load(RDX, t);
+			x_mov64(RDI, RSTATE);
+			x_call(io_wr32);
+			g_reload(1);
+			break;
+		}
+		g_load(RAX, a);
+		if (i) x_ri(0, RAX, i);
+		x_ri(4, RAX, mask[op]);
+		g_load(RCX, t);
+		jit_store(op, next);
+		break;
+	case 0b110: // B
+		g_load(RAX, a);
+		g_op(0x3B, RAX, t);
+		g_writeback();
+		x_movi(RAX, next);
+		x_movi(RCX, next + i);
+		x_rr(0x0F40 | br_cc[ins & 7], RAX, RCX); // cmovcc
+		x_count(next, 1);
+		x_epilogue();
+		break;
+	case 0b111: // J
+		if ((ins & 7) == J_JAL) {
+			g_storei(t, next);
+			x_count(next, 1);
+			x_exit(next + get_i21(ins));
+		} else { // J_SYSCALL
+			g_writeback();
+			x_rm(0xC7, 0, RSTATE, offsetof(CpuState, pc));
+			e32(next);
+			x_count(next, 1);
+			x_mov64(RDI, RSTATE);
+			x_movi(RSI, get_i21(ins));
+			x_call(do_syscall);
+			x_movi(RAX, next);
+			x_epilogue();
+		}
+		break;
+	}
+}
+
+static void jit_mark(JitBlock *b) {
+	for (uint32_t w = b->start >> 2; w < (b->end >> 2); w++) {
+		jit_words[w >> 5] |= 1U << (w & 31);
+	}
+}
+
+static void jit_flush(void) {
+	memset(jit_hash, 0, sizeof(jit_hash));
+	emu_clear(jit_pages, sizeof(JitBlock*) * (emu_ram_size / PAGESIZE));
+	emu_clear(jit_words, emu_ram_size / 32);
+	for (uint32_t n = 0; n < (emu_ram_size / PAGESIZE); n++) {
+		emu_codepage[n] &= ~CODE_JIT;
+	}
+	jit_nblocks = 0;
+	jit_next = jit_cache;
+}
+
+static int jit_translate(JitBlock *b) {
+	uint32_t ins[JIT_MAX_INS];
+	uint32_t uses[32];
+	uint32_t pc = b->pc;
+	uint32_t count = 0;
+	int kind = JK_NORMAL;
+
+	memset(uses, 0, sizeof(uses));
+	while (count < JIT_MAX_INS) {
+		uint32_t x = mem_rd32(pc);
+		kind = jit_kind(x);
+		if (kind == JK_UNDEF) break;
+		ins[count++] = x;
+		uses[get_rt(x)]++;
+		uses[get_ra(x)]++;
+		if (x & 0x10) uses[get_rb(x)]++;
+		pc += 4;
+		if (kind == JK_END) break;
+		if ((pc & (PAGESIZE - 1)) == 0) break;
+	}
+	if (count == 0) {
+		b->nojit = 1;
+		return 0;
+	}
+	if ((jit_next + JIT_MAX_CODE) > (jit_cache + JIT_CACHE_SIZE)) {
+		jit_flush();
+		return 0;
+	}
+
+	// keep the most used guest registers in host registers
+	memset(hreg, -1, sizeof(hreg));
+	dirty = 0;
+	uses[0] = 0;
+	for (uint32_t n = 0; n < 8; n++) {
+		uint32_t best = 0;
+		for (uint32_t g = 1; g < 32; g++) {
+			if ((hreg[g] < 0) && (uses[g] > uses[best])) best = g;
+		}
+		if (uses[best] < 2) break;
+		hreg[best] = allocatable[n];
+	}
+
+	cp = jit_next;
+	uint8_t *code = cp;
+	for (uint32_t n = 0; n < 6; n++) x_push(saved[n]);
+	e8(0x48); e8(0x83); e8(0xEC); e8(0x08); // sub rsp, 8
+	x_mov64(RSTATE, RDI);
+	x_movi64(RRAM, emu_ram);
+	for (uint32_t g = 1; g < 32; g++) {
+		if (hreg[g] >= 0) x_rm(0x8B, hreg[g], RSTATE, GOFF(g));
+	}
+
+	pc = b->pc;
+	jit_counted = pc;
+	for (uint32_t n = 0; n < count; n++) {
+		jit_ins(pc, ins[n]);
+		pc += 4;
+	}
+	if (kind != JK_END) {
+		x_count(pc, 1);
+		x_exit(pc);
+	}
+	jit_next = cp;
+
+	b->code = (void*) code;
+	b->start = b->pc & emu_mask32;
+	b->end = b->start + count * 4;
+	b->pnext = jit_pages[b->start >> PAGESHIFT];
+	jit_pages[b->start >> PAGESHIFT] = b;
+	emu_codepage[b->start >> PAGESHIFT] |= CODE_JIT;
+	jit_mark(b);
+	return 1;
+}
+
+void jit_invalidate(uint32_t addr) {
+	uint32_t w = addr >> 2;
+	if (!(jit_words[w >> 5] & (1U << (w & 31)))) {
+		return;
+	}
+	uint32_t page = addr >> PAGESHIFT;
+	JitBlock **pp = jit_pages + page;
+	JitBlock *b;
+	while ((b = *pp) != NULL) {
+		if ((addr >= b->start) && (addr < b->end)) {
+			// back to the interpreter until hot again
+			*pp = b->pnext;
+			b->code = NULL;
+			b->count = 0;
+			jit_hit = 1;
+		} else {
+			pp = &b->pnext;
+		}
+	}
+	memset(jit_words + (page << (PAGESHIFT - 7)), 0, PAGESIZE / 32);
+	for (b = jit_pages[page]; b; b = b->pnext) {
+		jit_mark(b);
+	}
+}
+
+static JitBlock *jit_lookup(uint32_t pc) {
+	JitBlock **bucket = jit_hash + ((pc >> 2) & (JIT_HASH_SIZE - 1));
+	JitBlock *b;
+	for (b = *bucket; b; b = b->hnext) {
+		if (b->pc == pc) return b;
+	}
+	if (jit_nblocks == JIT_MAX_BLOCKS) {
+		jit_flush();
+	}
+	b = jit_blocks + jit_nblocks++;
+	memset(b, 0, sizeof(*b));
+	b->pc = pc;
+	b->hnext = *bucket;
+	*bucket = b;
+	return b;
+}
+
+static void jit_init(void) {
+	if (jit_cache != NULL) return;
+	jit_cache = mmap(NULL, JIT_CACHE_SIZE,
+		PROT_READ | PROT_WRITE | PROT_EXEC,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit_cache == MAP_FAILED) {
+		fprintf(stderr, "emu: cannot allocate jit cache\n");
+		exit(1);
+	}
+	jit_next = jit_cache;
+	jit_pages = emu_alloc(sizeof(JitBlock*) * (emu_ram_size / PAGESIZE));
+	jit_words = emu_alloc(emu_ram_size / 32);
+}
+
+void sr32core_jit(CpuState *s) {
+	jit_init();
+	for (;;) {
+		JitBlock *b = jit_lookup(s->pc);
+		if (b->code) {
+			s->pc = b->code(s);
+			if (s->countdown <= 0) sched_run(s);
+			continue;
+		}
+		if (!b->nojit && (++b->count >= JIT_HOT) && jit_translate(b)) {
+			continue;
+		}
+		if (sr32block_predecode(s)) {
+			return;
+		}
+	}
+}
+
+// run one block, translated or interpreted
+int sr32block_jit(CpuState *s) {
+	jit_init();
+	JitBlock *b = jit_lookup(s->pc);
+	if (b->code || (!b->nojit && (++b->count >= JIT_HOT) && jit_translate(b))) {
+		s->pc = b->code(s);
+		if (s->countdown <= 0) sched_run(s);
+		return 0;
+	}
+	return sr32block_predecode(s);
+}
+
+#else
+
+void sr32core_jit(CpuState *s) {
+	fprintf(stderr, "emu: no jit for this host, using predecode\n");
+	sr32core_predecode(s);
+}
+
+int sr32block_jit(CpuState *s) {
+	return sr32block_predecode(s);
+}
+
+void jit_invalidate(uint32_t addr) {
+}
+
+#endif
@@ -0,0 +1,229 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Predecoding execution engine
+//
+// Each guest word is decoded once into a DecodedIns record in
+// emu_dcode[] (handler index, register fields, sign-extended and
+// pre-shifted immediate).  Subsequent executions of the same word
+// dispatch directly on the record.  Stores to pages flagged in
+// emu_codepage[] reset the affected record to PD_DECODE.
+//
+// sr32block_predecode() runs a single basic block and is used
+// as the cold tier by the jit engine.  sr32slice_predecode() does
+// the same for libsr32's time slices, which must end exactly.
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <emulator-sr32.h>
+#include <sr32.h>
+
+// handler index by low 6 bits of the instruction word
+static const uint8_t optab[64] = {
+	PD_ADDI, PD_SUBI, PD_ANDI, PD_ORI, PD_XORI, PD_SLLI, PD_SRLI, PD_SRAI,
+	PD_SLTI, PD_SLTUI, PD_MULI, PD_DIVI, PD_UNDEF, PD_UNDEF, PD_UNDEF, PD_JALRI,
+	PD_ADD, PD_SUB, PD_AND, PD_OR, PD_XOR, PD_SLL, PD_SRL, PD_SRA,
+	PD_SLT, PD_SLTU, PD_MUL, PD_DIV, PD_AMOSWAP, PD_AMOADD, PD_AMOCAS, PD_JALR,
+	PD_LDW, PD_LDH, PD_LDB, PD_LDX, PD_LI, PD_LDHU, PD_LDBU, PD_AUIPC,
+	PD_STW, PD_STH, PD_STB, PD_STX, PD_UNDEF, PD_UNDEF, PD_UNDEF, PD_UNDEF,
+	PD_BEQ, PD_BNE, PD_BLT, PD_BLTU, PD_BGE, PD_BGEU, PD_UNDEF, PD_UNDEF,
+	PD_JAL, PD_SYSCALL, PD_UNDEF, PD_UNDEF, PD_UNDEF, PD_UNDEF, PD_UNDEF, PD_UNDEF,
+};
+
+void sr32decode(uint32_t ins, DecodedIns *d) {
+	DecodedIns n;
+
+	n.op = optab[ins & 63];
+	n.t = get_rt(ins);
+	n.a = get_ra(ins);
+	n.b = get_rb(ins);
+	n.i = get_i16(ins);
+
+	switch (n.op) {
+	case PD_SLLI: case PD_SRLI: case PD_SRAI:
+		n.i &= 31;
+		break;
+	case PD_LI: case PD_AUIPC:
+		n.i = ins & 0xFFFF0000;
+		break;
+	case PD_JAL: case PD_SYSCALL:
+		n.i = get_i21(ins);
+		break;
+	}
+
+	// results written to r0 are discarded, so side-effect
+	// free ops targeting it need not execute at all
+	if (n.t == 0) {
+		switch (n.op) {
+		case PD_ADDI: case PD_SUBI: case PD_ANDI: case PD_ORI:
+		case PD_XORI: case PD_SLLI: case PD_SRLI: case PD_SRAI:
+		case PD_SLTI: case PD_SLTUI: case PD_MULI:
+		case PD_ADD: case PD_SUB: case PD_AND: case PD_OR:
+		case PD_XOR: case PD_SLL: case PD_SRL: case PD_SRA:
+		case PD_SLT: case PD_SLTU: case PD_MUL:
+		case PD_LDW: case PD_LDH: case PD_LDB: case PD_LI:
+		case PD_LDHU: case PD_LDBU: case PD_AUIPC:
+			n.op = PD_NOP;
+			break;
+		}
+	}
+	*d = n;
+}
+
+// Another hart may store to the word meanwhile, resetting op after
+// writing RAM (see mem_invalidate()).  Publishing op last and then
+// checking the word is unchanged leaves either a current decode or
+// op 0, to decode again, but never a stale decode.
+static void decode(DecodedIns *d, uint32_t pc) {
+	DecodedIns n;
+	emu_codepage[(pc & emu_mask32) >> PAGESHIFT] |= CODE_DECODED;
+	uint32_t ins = mem_rd32(pc);
+	sr32decode(ins, &n);
+	d->t = n.t;
+	d->a = n.a;
+	d->b = n.b;
+	d->i = n.i;
+	__atomic_store_n(&d->op, n.op, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (mem_rd32(pc) != ins) {
+		__atomic_store_n(&d->op, PD_DECODE, __ATOMIC_RELAXED);
+	}
+}
+
+// address following d, the last instruction of the block from start
+static inline uint32_t pd_end(uint32_t start, DecodedIns *d) {
+	return start + ((((d - emu_dcode) << 2) - start) & emu_mask32) + 4;
+}
+
+// With oneblock set, execution stops after the first control
+// transfer (branch, jump, syscall) with s->pc at its destination.
+// With sliced also set, it stops after at most left instructions
+// and returns 1 after a syscall.  Returns -1 if execution stopped
+// on an undefined instruction.
+static inline __attribute__((always_inline))
+int pd_exec(CpuState *s, int oneblock, int sliced, uint32_t left) {
+	int32_t *r = s->r;
+	uint32_t pc = s->pc;
+	uint32_t start = pc;	// first instruction not yet counted
+	uint32_t first = pc;	// the block runs straight on from here
+	int32_t n;
+	for (;;) {
+	if (sliced && (((pc - first) >> 2) >= left)) {
+		s->pc = pc;
+		sched_count(s, start, pc);
+		return 0;
+	}
+	DecodedIns *d = emu_dcode + ((pc & emu_mask32) >> 2);
+	pc += 4;
+	switch (__atomic_load_n(&d->op, __ATOMIC_ACQUIRE)) {
+	case PD_DECODE:
+		pc -= 4;
+		decode(d, pc);
+		continue;
+	case PD_NOP: break;
+	case PD_ADDI: r[d->t] = r[d->a] + d->i; break;
+	case PD_SUBI: r[d->t] = r[d->a] - d->i; break;
+	case PD_ANDI: r[d->t] = r[d->a] & d->i; break;
+	case PD_ORI: r[d->t] = r[d->a] | d->i; break;
+	case PD_XORI: r[d->t] = r[d->a] ^ d->i; break;
+	case PD_SLLI: r[d->t] = r[d->a] << d->i; break;
+	case PD_SRLI: r[d->t] = ((uint32_t)r[d->a]) >> d->i; break;
+	case PD_SRAI: r[d->t] = r[d->a] >> d->i; break;
+	case PD_SLTI: r[d->t] = (r[d->a] < d->i) ? 1 : 0; break;
+	case PD_SLTUI: r[d->t] = (((uint32_t)r[d->a]) < ((uint32_t)d->i)) ? 1 : 0; break;
+	case PD_MULI: r[d->t] = r[d->a] * d->i; break;
+	case PD_DIVI: n = r[d->a] / d->i; if (d->t) r[d->t] = n; break;
+	case PD_JALRI:
+		n = pc;
+		pc = r[d->a] + d->i;
+		if (d->t) r[d->t] = n;
+		goto endblock;
+	case PD_ADD: r[d->t] = r[d->a] + r[d->b]; break;
+	case PD_SUB: r[d->t] = r[d->a] - r[d->b]; break;
+	case PD_AND: r[d->t] = r[d->a] & r[d->b]; break;
+	case PD_OR: r[d->t] = r[d->a] | r[d->b]; break;
+	case PD_XOR: r[d->t] = r[d->a] ^ r[d->b]; break;
+	case PD_SLL: r[d->t] = r[d->a] << (r[d->b] & 31); break;
+	case PD_SRL: r[d->t] = ((uint32_t)r[d->a]) >> (r[d->b] & 31); break;
+	case PD_SRA: r[d->t] = r[d->a] >> (r[d->b] & 31); break;
+	case PD_SLT: r[d->t] = (r[d->a] < r[d->b]) ? 1 : 0; break;
+	case PD_SLTU: r[d->t] = (((uint32_t)r[d->a]) < ((uint32_t)r[d->b])) ? 1 : 0; break;
+	case PD_MUL: r[d->t] = r[d->a] * r[d->b]; break;
+	case PD_DIV: n = r[d->a] / r[d->b]; if (d->t) r[d->t] = n; break;
+	case PD_JALR:
+		n = pc;
+		pc = r[d->a] + r[d->b];
+		if (d->t) r[d->t] = n;
+		goto endblock;
+	case PD_AMOSWAP: case PD_AMOADD: case PD_AMOCAS:
+		n = mem_amo32(d->op - PD_AMOSWAP + IR_AMOSWAP, r[d->a], r[d->t], r[d->b]);
+		if (d->t) r[d->t] = n;
+		break;
+	case PD_LDW: r[d->t] = mem_rd32(r[d->a] + d->i); break;
+	case PD_LDH: r[d->t] = (int16_t) mem_rd16(r[d->a] + d->i); break;
+	case PD_LDB: r[d->t] = (int8_t) mem_rd8(r[d->a] + d->i); break;
+	case PD_LDX:
+		s->pc = pc;
+		sched_count(s, start, pc);
+		start = pc;
+		n = io_rd32(s, r[d->a] + d->i);
+		if (d->t) r[d->t] = n;
+		break;
+	case PD_LI: r[d->t] = d->i; break;
+	case PD_LDHU: r[d->t] = mem_rd16(r[d->a] + d->i); break;
+	case PD_LDBU: r[d->t] = mem_rd8(r[d->a] + d->i); break;
+	case PD_AUIPC: r[d->t] = pc + d->i; break;
+	case PD_STW: mem_wr32(r[d->a] + d->i, r[d->t]); break;
+	case PD_STH: mem_wr16(r[d->a] + d->i, r[d->t]); break;
+	case PD_STB: mem_wr8(r[d->a] + d->i, r[d->t]); break;
+	case PD_STX:
+		s->pc = pc;
+		sched_count(s, start, pc);
+		start = pc;
+		io_wr32(s, r[d->a] + d->i, r[d->t]);
+		break;
+	case PD_BEQ: if (r[d->a] == r[d->t]) pc += d->i; goto endblock;
+	case PD_BNE: if (r[d->a] != r[d->t]) pc += d->i; goto endblock;
+	case PD_BLT: if (r[d->a] < r[d->t]) pc += d->i; goto endblock;
+	case PD_BLTU: if (((uint32_t)r[d->a]) < ((uint32_t)r[d->t])) pc += d->i; goto endblock;
+	case PD_BGE: if (r[d->a] >= r[d->t]) pc += d->i; goto endblock;
+	case PD_BGEU: if (((uint32_t)r[d->a]) >= ((uint32_t)r[d->t])) pc += d->i; goto endblock;
+	case PD_JAL:
+		if (d->t) r[d->t] = pc;
+		pc += d->i;
+		goto endblock;
+	case PD_SYSCALL:
+		s->pc = pc;
+		sched_block(s, start, pc);
+		do_syscall(s, d->i);
+		if (sliced) return 1;
+		goto counted;
+	default: // PD_UNDEF
+		s->pc = pc;
+		do_undef(s, mem_rd32(pc - 4));
+		return -1;
+	}
+	continue;
+endblock:
+	sched_block(s, start, pd_end(start, d));
+counted:
+	start = pc;
+	if (oneblock) {
+		s->pc = pc;
+		return 0;
+	}
+	}
+}
+
+void sr32core_predecode(CpuState *s) {
+	pd_exec(s, 0, 0, 0);
+}
+
+int sr32block_predecode(CpuState *s) {
+	return pd_exec(s, 1, 0, 0);
+}
+
+int sr32slice_predecode(CpuState *s, uint32_t left) {
+	return pd_exec(s, 1, 1, left);
+}
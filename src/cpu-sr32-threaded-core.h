@@ -0,0 +1,174 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Direct-threaded variant of the reference interpreter body,
+// instantiated like cpu-sr32-core.h (see cpu-sr32-threaded.c).
+
+#define TRACE_FETCH() \
+	if (TRACING(F_TRACE_FETCH | F_PROFILE)) { \
+		if (TRACING(F_TRACE_FETCH)) { \
+			if (TRACING(F_TRACE_BIN)) trace_fetch(pc, ins); \
+			else fprintf(stderr,"%08x %08x\n", pc, ins); \
+		} \
+		if (TRACING(F_PROFILE)) prof_count[(pc & emu_mask32) >> 2]++; \
+	}
+#define TRACE_CALL(t, from, to) \
+	if (TRACING(F_PROFILE) && ((t) == 1)) prof_call(from, to)
+#define TRACE_REG(n, t) \
+	if (TRACING(F_TRACE_REGS)) { \
+		if (TRACING(F_TRACE_BIN)) trace_reg(n, t); \
+		else fprintf(stderr,"%08x -> X%d\n", n, t); \
+	}
+
+#define DISPATCH() do { \
+	ins = mem_rd32(pc); \
+	TRACE_FETCH(); \
+	pc += 4; \
+	goto *optab[ins & 63]; \
+	} while (0)
+
+// count the block ending with this instruction
+#define BLOCK_END() sched_block(s, start, pc)
+// the lockstep instance returns at the end of each block
+#define BLOCK_DONE() if (TRACING(F_LOCKSTEP)) { s->pc = pc; return; }
+#define BRANCH(c) do { \
+	BLOCK_END(); \
+	if (c) pc += I16; \
+	start = pc; \
+	BLOCK_DONE(); \
+	DISPATCH(); \
+	} while (0)
+#define IO_SYNC() do { \
+	s->pc = pc; \
+	sched_count(s, start, pc); \
+	start = pc; \
+	} while (0)
+#define STORE(a) if (TRACING(F_LOCKSTEP)) lockstep_store(a)
+
+#define RA (s->r[(ins >> 11) & 31])
+#define RB (s->r[(ins >> 16) & 31])
+#define RT (s->r[(ins >> 6) & 31])
+#define I16 (ins >> 16)
+#define I21 (ins >> 11)
+
+#define WRITE_RT(v) do { \
+	n = (v); \
+	t = (ins >> 6) & 31; \
+	if (t) { \
+		s->r[t] = n; \
+		TRACE_REG(n, t); \
+	} \
+	} while (0)
+
+void CORE_FN(CpuState *s) {
+	static const void *optab[64] = {
+		&&op_addi, &&op_subi, &&op_andi, &&op_ori,
+		&&op_xori, &&op_slli, &&op_srli, &&op_srai,
+		&&op_slti, &&op_sltui, &&op_muli, &&op_divi,
+		&&op_undef, &&op_undef, &&op_undef, &&op_jalri,
+		&&op_add, &&op_sub, &&op_and, &&op_or,
+		&&op_xor, &&op_sll, &&op_srl, &&op_sra,
+		&&op_slt, &&op_sltu, &&op_mul, &&op_div,
+		&&op_amo, &&op_amo, &&op_amo, &&op_jalr,
+		&&op_ldw, &&op_ldh, &&op_ldb, &&op_ldx,
+		&&op_lui, &&op_ldhu, &&op_ldbu, &&op_auipc,
+		&&op_stw, &&op_sth, &&op_stb, &&op_stx,
+		&&op_undef, &&op_undef, &&op_undef, &&op_undef,
+		&&op_beq, &&op_bne, &&op_blt, &&op_bltu,
+		&&op_bge, &&op_bgeu, &&op_undef, &&op_undef,
+		&&op_jal, &&op_syscall, &&op_undef, &&op_undef,
+		&&op_undef, &&op_undef, &&op_undef, &&op_undef,
+	};
+	uint32_t pc = s->pc;
+	uint32_t start = pc;	// first instruction not yet counted
+	int32_t ins, n, a;
+	uint32_t t;
+
+	DISPATCH();
+
+op_addi: WRITE_RT(RA + I16); DISPATCH();
+op_subi: WRITE_RT(RA - I16); DISPATCH();
+op_andi: WRITE_RT(RA & I16); DISPATCH();
+op_ori: WRITE_RT(RA | I16); DISPATCH();
+op_xori: WRITE_RT(RA ^ I16); DISPATCH();
+op_slli: WRITE_RT(RA << (I16 & 31)); DISPATCH();
+op_srli: WRITE_RT(((uint32_t)RA) >> (I16 & 31)); DISPATCH();
+op_srai: WRITE_RT(RA >> (I16 & 31)); DISPATCH();
+op_slti: WRITE_RT((RA < I16) ? 1 : 0); DISPATCH();
+op_sltui: WRITE_RT((((uint32_t)RA) < ((uint32_t)I16)) ? 1 : 0); DISPATCH();
+op_muli: WRITE_RT(RA * I16); DISPATCH();
+op_divi: WRITE_RT(RA / I16); DISPATCH();
+op_jalri: a = RA + I16; WRITE_RT(pc); TRACE_CALL(t, pc - 4, a); BLOCK_END(); pc = start = a; BLOCK_DONE(); DISPATCH();
+
+op_add: WRITE_RT(RA + RB); DISPATCH();
+op_sub: WRITE_RT(RA - RB); DISPATCH();
+op_and: WRITE_RT(RA & RB); DISPATCH();
+op_or: WRITE_RT(RA | RB); DISPATCH();
+op_xor: WRITE_RT(RA ^ RB); DISPATCH();
+op_sll: WRITE_RT(RA << (RB & 31)); DISPATCH();
+op_srl: WRITE_RT(((uint32_t)RA) >> (RB & 31)); DISPATCH();
+op_sra: WRITE_RT(RA >> (RB & 31)); DISPATCH();
+op_slt: WRITE_RT((RA < RB) ? 1 : 0); DISPATCH();
+op_sltu: WRITE_RT((((uint32_t)RA) < ((uint32_t)RB)) ? 1 : 0); DISPATCH();
+op_mul: WRITE_RT(RA * RB); DISPATCH();
+op_div: WRITE_RT(RA / RB); DISPATCH();
+op_jalr: a = RA + RB; WRITE_RT(pc); TRACE_CALL(t, pc - 4, a); BLOCK_END(); pc = start = a; BLOCK_DONE(); DISPATCH();
+op_amo: STORE(RA); WRITE_RT(mem_amo32(ins & 15, RA, RT, RB)); DISPATCH();
+
+op_ldw: WRITE_RT(mem_rd32(RA + I16)); DISPATCH();
+op_ldh: WRITE_RT((int16_t) mem_rd16(RA + I16)); DISPATCH();
+op_ldb: WRITE_RT((int8_t) mem_rd8(RA + I16)); DISPATCH();
+op_ldx: IO_SYNC(); WRITE_RT(io_rd32(s, RA + I16)); DISPATCH();
+op_lui: WRITE_RT(ins & 0xFFFF0000); DISPATCH();
+op_ldhu: WRITE_RT(mem_rd16(RA + I16)); DISPATCH();
+op_ldbu: WRITE_RT(mem_rd8(RA + I16)); DISPATCH();
+op_auipc: WRITE_RT(pc + (ins & 0xFFFF0000)); DISPATCH();
+
+op_stw: STORE(RA + I16); mem_wr32(RA + I16, RT); DISPATCH();
+op_sth: STORE(RA + I16); mem_wr16(RA + I16, RT); DISPATCH();
+op_stb: STORE(RA + I16); mem_wr8(RA + I16, RT); DISPATCH();
+op_stx: STORE(RA + I16); IO_SYNC(); io_wr32(s, RA + I16, RT); DISPATCH();
+
+op_beq: BRANCH(RA == RT);
+op_bne: BRANCH(RA != RT);
+op_blt: BRANCH(RA < RT);
+op_bltu: BRANCH(((uint32_t)RA) < ((uint32_t)RT));
+op_bge: BRANCH(RA >= RT);
+op_bgeu: BRANCH(((uint32_t)RA) >= ((uint32_t)RT));
+
+op_jal:
+	t = (ins >> 6) & 31;
+	if (t) s->r[t] = pc;
+	TRACE_CALL(t, pc - 4, pc + I21);
+	BLOCK_END();
+	pc += I21;
+	start = pc;
+	BLOCK_DONE();
+	DISPATCH();
+op_syscall:
+	s->pc = pc;
+	BLOCK_END();
+	start = pc;
+	do_syscall(s, I21);
+	BLOCK_DONE();
+	DISPATCH();
+op_undef:
+	s->pc = pc;
+	do_undef(s, ins);
+}
+
+#undef TRACE_FETCH
+#undef TRACE_CALL
+#undef TRACE_REG
+#undef DISPATCH
+#undef BLOCK_END
+#undef BLOCK_DONE
+#undef BRANCH
+#undef IO_SYNC
+#undef STORE
+#undef RA
+#undef RB
+#undef RT
+#undef I16
+#undef I21
+#undef WRITE_RT
@@ -0,0 +1,18 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Direct-threaded variant of the reference interpreter
+//
+// Built instead of cpu-sr32.c when THREADED=1 is passed to make.
+// Each of the 64 opcodes (low 6 bits of the instruction word) has
+// its own handler which ends in its own fetch and indirect jump,
+// giving the host branch predictor one history per opcode rather
+// than a single shared dispatch point.
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <emulator-sr32.h>
+
+#define CORE_TEMPLATE <cpu-sr32-threaded-core.h>
+#include <cpu-sr32-variants.h>
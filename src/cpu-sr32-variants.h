@@ -0,0 +1,140 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Instantiates the interpreter body in CORE_TEMPLATE once for each
+// combination of the flags it tests per instruction, as functions
+// sr32core_0 .. sr32core_15, with TRACING(f) a compile time constant
+// in each.  sr32core_select() returns the instance for a set of
+// CpuState flags, and sr32core() runs it.  A further instance,
+// sr32block_ref(), runs one block at a time for -lockstep.
+
+#define TRACING(f) (CORE_FLAGS & (f))
+
+#define CORE_FN sr32core_0
+#define CORE_FLAGS (0)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_1
+#define CORE_FLAGS (F_TRACE_FETCH)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_2
+#define CORE_FLAGS (F_TRACE_REGS)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_3
+#define CORE_FLAGS (F_TRACE_FETCH | F_TRACE_REGS)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_4
+#define CORE_FLAGS (F_PROFILE)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_5
+#define CORE_FLAGS (F_TRACE_FETCH | F_PROFILE)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_6
+#define CORE_FLAGS (F_TRACE_REGS | F_PROFILE)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_7
+#define CORE_FLAGS (F_TRACE_FETCH | F_TRACE_REGS | F_PROFILE)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_8
+#define CORE_FLAGS (F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_9
+#define CORE_FLAGS (F_TRACE_FETCH | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_10
+#define CORE_FLAGS (F_TRACE_REGS | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_11
+#define CORE_FLAGS (F_TRACE_FETCH | F_TRACE_REGS | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_12
+#define CORE_FLAGS (F_PROFILE | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_13
+#define CORE_FLAGS (F_TRACE_FETCH | F_PROFILE | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_14
+#define CORE_FLAGS (F_TRACE_REGS | F_PROFILE | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_15
+#define CORE_FLAGS (F_TRACE_FETCH | F_TRACE_REGS | F_PROFILE | F_TRACE_BIN)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#define CORE_FN sr32core_lockstep
+#define CORE_FLAGS (F_LOCKSTEP)
+#include CORE_TEMPLATE
+#undef CORE_FN
+#undef CORE_FLAGS
+
+#undef TRACING
+
+static void (*const sr32core_variant[16])(CpuState *s) = {
+	sr32core_0, sr32core_1, sr32core_2, sr32core_3,
+	sr32core_4, sr32core_5, sr32core_6, sr32core_7,
+	sr32core_8, sr32core_9, sr32core_10, sr32core_11,
+	sr32core_12, sr32core_13, sr32core_14, sr32core_15,
+};
+
+CoreFn sr32core_select(uint32_t flags) {
+	uint32_t n = 0;
+	if (flags & F_TRACE_FETCH) n |= 1;
+	if (flags & F_TRACE_REGS) n |= 2;
+	if (flags & F_PROFILE) n |= 4;
+	if (flags & F_TRACE_BIN) n |= 8;
+	return sr32core_variant[n];
+}
+
+void sr32core(CpuState *s) {
+	sr32core_select(s->flags)(s);
+}
+
+int sr32block_ref(CpuState *s) {
+	sr32core_lockstep(s);
+	return 0;
+}
@@ -6,78 +6,814 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
 
 #include <emulator-sr32.h>
+#include <image-sr32.h>
+#include <sr32.h>
+#include <syscall-sr32.h>
 
-#define RAMSIZE   (8*1024*1024)
-#define RAMMASK8  (RAMSIZE - 1)
-#define RAMMASK32 (RAMMASK8 & (~3))
-#define RAMMASK16 (RAMMASK8 & (~1))
-uint8_t emu_ram[RAMSIZE];
+EMU_GUEST uint8_t *emu_ram;
+EMU_GUEST uint64_t emu_ram_size;
+EMU_GUEST uint32_t emu_mask8;
+EMU_GUEST uint32_t emu_mask16;
+EMU_GUEST uint32_t emu_mask32;
+EMU_GUEST DecodedIns *emu_dcode;
+EMU_GUEST uint8_t *emu_codepage;
+
+// zeroed memory, or NULL if it cannot be mapped
+void *emu_alloc_try(uint64_t len) {
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return (p == MAP_FAILED) ? NULL : p;
+}
+
+void *emu_alloc(uint64_t len) {
+	void *p = emu_alloc_try(len);
+	if (p == NULL) {
+		fprintf(stderr, "emu: cannot allocate %llu bytes\n",
+			(unsigned long long) len);
+		exit(1);
+	}
+	return p;
+}
+
+// return an emu_alloc() region to zero, releasing its pages
+// rather than touching them.  Fresh anonymous pages replace any
+// file mapped over it (by load_image() or sys_mmap()), which
+// MADV_DONTNEED would only return to the file's contents.
+void emu_clear(void *p, uint64_t len) {
+	if ((len < (64 * PAGESIZE)) || ((((uintptr_t) p) | len) & (PAGESIZE - 1)) ||
+		(mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+		MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)) {
+		memset(p, 0, len);
+	}
+}
+
+void emu_ram_init(uint64_t size, int hugepages) {
+	emu_ram = emu_alloc(size);
+	if (hugepages) {
+		if (madvise(emu_ram, size, MADV_HUGEPAGE)) {
+			fprintf(stderr, "emu: transparent huge pages unavailable\n");
+		}
+	}
+	emu_ram_size = size;
+	emu_mask8 = size - 1;
+	emu_mask16 = emu_mask8 & (~1);
+	emu_mask32 = emu_mask8 & (~3);
+	emu_dcode = emu_alloc(sizeof(DecodedIns) * (size / 4));
+	emu_codepage = emu_alloc(size / PAGESIZE);
+}
+
+// stores to pages holding predecoded or translated instructions
+// must discard the decode and any translation of the modified word
+static inline void mem_invalidate(uint32_t addr) {
+	uint32_t flags = emu_codepage[addr >> PAGESHIFT];
+	if (flags) {
+		__atomic_store_n(&emu_dcode[addr >> 2].op, PD_DECODE, __ATOMIC_RELEASE);
+		if (flags & CODE_JIT) {
+			jit_invalidate(addr);
+		}
+		if (flags & CODE_BLOCKS) {
+			blocks_invalidate(addr);
+		}
+	}
+}
 
 uint32_t mem_rd32(uint32_t addr) {
-	return *((uint32_t*) (emu_ram + (addr & RAMMASK32)));
+	return *((uint32_t*) (emu_ram + (addr & emu_mask32)));
 }
 uint32_t mem_rd16(uint32_t addr) {
-	return *((uint16_t*) (emu_ram + (addr & RAMMASK16)));
+	return *((uint16_t*) (emu_ram + (addr & emu_mask16)));
 }
 uint32_t mem_rd8(uint32_t addr) {
-	return *((uint8_t*) (emu_ram + (addr & RAMMASK8)));
+	return *((uint8_t*) (emu_ram + (addr & emu_mask8)));
 }
 
 void mem_wr32(uint32_t addr, uint32_t val) {
-	*((uint32_t*) (emu_ram + (addr & RAMMASK32))) = val;
+	addr &= emu_mask32;
+	*((uint32_t*) (emu_ram + addr)) = val;
+	mem_invalidate(addr);
 }
 void mem_wr16(uint32_t addr, uint32_t val) {
-	*((uint16_t*) (emu_ram + (addr & RAMMASK16))) = val;
+	addr &= emu_mask16;
+	*((uint16_t*) (emu_ram + addr)) = val;
+	mem_invalidate(addr);
 }
 void mem_wr8(uint32_t addr, uint32_t val) {
-	*((uint8_t*) (emu_ram + (addr & RAMMASK8))) = val;
+	addr &= emu_mask8;
+	*((uint8_t*) (emu_ram + addr)) = val;
+	mem_invalidate(addr);
+}
+
+uint32_t mem_amo32(uint32_t op, uint32_t addr, uint32_t cmp, uint32_t val) {
+	addr &= emu_mask32;
+	uint32_t *p = (uint32_t*) (emu_ram + addr);
+	uint32_t old;
+	switch (op) {
+	case IR_AMOSWAP:
+		old = __atomic_exchange_n(p, val, __ATOMIC_SEQ_CST);
+		break;
+	case IR_AMOADD:
+		old = __atomic_fetch_add(p, val, __ATOMIC_SEQ_CST);
+		break;
+	default: // IR_AMOCAS
+		old = cmp;
+		__atomic_compare_exchange_n(p, &old, val, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		break;
+	}
+	mem_invalidate(addr);
+	return old;
 }
 
 void *mem_dma(uint32_t addr, uint32_t len) {
-	if (addr >= RAMSIZE) return 0;
-	if ((RAMSIZE - addr) < len) return 0;
+	if (addr >= emu_ram_size) return 0;
+	if ((emu_ram_size - addr) < len) return 0;
 	return emu_ram + addr;
 }
 
-uint32_t io_rd32(CpuState *cs, uint32_t addr) {
+// set in test vector runs (see run_vectors())
+typedef struct {
+	uint32_t done;		// exit port was written
+	uint32_t code;
+} VecResult;
+
+static VecResult *vec_result;
+
+static uint32_t emu_harts = 1;
+static uint64_t emu_max_insns;	// per hart watchdog, 0 for none
+
+// Snapshots
+//
+// A SnapHeader (including hart 0's CpuState) followed by snap.pages
+// records of a SnapPage and PAGESIZE bytes of data.  Only guest
+// pages that are resident (see mincore()) and not all zero are
+// written; everything else is zero on restore.  Snapshots are taken
+// on stx -8 (exiting afterward if the value written is nonzero) or
+// at the next ldx, stx, or syscall after SIGUSR1.
+
+#define SNAP_MAGIC   0x53335253 // "SR3S"
+#define SNAP_VERSION 2
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t ramsize;
+	uint32_t pages;
+	uint32_t reserved;
+	CpuState cs;
+} SnapHeader;
+
+typedef struct {
+	uint32_t addr;
+} SnapPage;
+
+static const char *snap_file = "emu.snap";
+static volatile sig_atomic_t snap_request;
+
+static int page_is_zero(const uint8_t *p) {
+	const uint64_t *x = (const uint64_t*) p;
+	for (uint32_t n = 0; n < (PAGESIZE / 8); n++) {
+		if (x[n]) return 0;
+	}
+	return 1;
+}
+
+static void snap_save(CpuState *cs) {
+	uint64_t count = emu_ram_size / PAGESIZE;
+	unsigned char *resident = malloc(count);
+	SnapHeader hdr;
+
+	if (emu_harts > 1) {
+		fprintf(stderr, "emu: snapshots require a single hart\n");
+		return;
+	}
+	if ((resident == NULL) || mincore(emu_ram, emu_ram_size, resident)) {
+		fprintf(stderr, "emu: cannot scan guest memory\n");
+		exit(1);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = SNAP_MAGIC;
+	hdr.version = SNAP_VERSION;
+	hdr.ramsize = emu_ram_size;
+	hdr.cs = *cs;
+	hdr.cs.flags = 0;
+	for (uint64_t n = 0; n < count; n++) {
+		if (resident[n] & 1) {
+			if (page_is_zero(emu_ram + n * PAGESIZE)) {
+				resident[n] = 0;
+			} else {
+				hdr.pages++;
+			}
+		}
+	}
+
+	FILE *fp = fopen(snap_file, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "emu: cannot write to: %s\n", snap_file);
+		exit(1);
+	}
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	for (uint64_t n = 0; n < count; n++) {
+		if (resident[n] & 1) {
+			SnapPage pg = { .addr = n * PAGESIZE };
+			fwrite(&pg, sizeof(pg), 1, fp);
+			fwrite(emu_ram + pg.addr, PAGESIZE, 1, fp);
+		}
+	}
+	if (fclose(fp)) {
+		fprintf(stderr, "emu: error writing: %s\n", snap_file);
+		exit(1);
+	}
+	free(resident);
+}
+
+static void snap_wr(IoDevice *dev, CpuState *cs, uint32_t addr, uint32_t val) {
+	snap_save(cs);
+	if (val) exit(0);
+}
+
+static IoDevice snap_dev = {
+	.name = "snapshot", .base = -8, .size = 1, .wr32 = snap_wr,
+};
+
+// Harts
+//
+// Each hart runs the selected core on its own host thread over the
+// shared guest RAM.  Hart 0 starts at the image entry point and the
+// others wait until another hart starts them.  A stopped hart parks
+// its thread and on its next start unwinds out of the core (via
+// longjmp) to begin again at the new pc.
+//
+// ldx -4  hart id            stx -4  start pc for the next hart start
+// ldx -5  number of harts    stx -5  start argument (a0) for the same
+// ldx -6  mask of running    stx -6  start hart n (if stopped)
+//                            stx -7  stop hart n
+//
+// A hart stopping itself stops immediately.  A stop sent to another
+// hart takes effect at that hart's next ldx, stx, or syscall.
+
+typedef struct {
+	CpuState cs;
+	pthread_t thread;
+	jmp_buf restart;
+	uint32_t stop;		// stop requested by another hart
+	uint32_t start_pc;	// latched by this hart for its next start
+	uint32_t start_arg;
+	uint32_t con_len;	// byte count for the next console bulk write
+} Hart;
+
+static Hart emu_hart[HART_MAX];
+static uint32_t hart_running;
+static pthread_mutex_t hart_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hart_wake = PTHREAD_COND_INITIALIZER;
+static CoreFn emu_core;
+
+static void *hart_main(void *arg) {
+	Hart *h = arg;
+	uint32_t bit = 1U << h->cs.hart;
+	setjmp(h->restart);
+	pthread_mutex_lock(&hart_lock);
+	while (!(hart_running & bit)) {
+		pthread_cond_wait(&hart_wake, &hart_lock);
+	}
+	pthread_mutex_unlock(&hart_lock);
+	emu_core(&h->cs);
+	return NULL;
+}
+
+// cs is the state the core is running on (h->cs, except in libsr32)
+static void hart_park(Hart *h, CpuState *cs) {
+	pthread_mutex_lock(&hart_lock);
+	hart_running &= ~(1U << cs->hart);
+	h->stop = 0;
+	if (hart_running == 0) {
+		pthread_mutex_unlock(&hart_lock);
+		if (emu_stop_hook) emu_stop_hook(cs, STOP_HALT, 0);
+		fprintf(stderr, "emu: all harts stopped\n");
+		exit(1);
+	}
+	pthread_mutex_unlock(&hart_lock);
+	longjmp(h->restart, 1);
+}
+
+static void hart_start(Hart *self, uint32_t n) {
+	if (n >= emu_harts) return;
+	Hart *h = emu_hart + n;
+	pthread_mutex_lock(&hart_lock);
+	if (!(hart_running & (1U << n))) {
+		memset(h->cs.r, 0, sizeof(h->cs.r));
+		h->cs.pc = self->start_pc;
+		h->cs.r[10] = self->start_arg;
+		h->stop = 0;
+		hart_running |= 1U << n;
+		pthread_cond_broadcast(&hart_wake);
+	}
+	pthread_mutex_unlock(&hart_lock);
+}
+
+static void hart_stop(Hart *self, CpuState *cs, uint32_t n) {
+	if (n >= emu_harts) return;
+	if (n == cs->hart) {
+		hart_park(self, cs);
+	}
+	__atomic_store_n(&emu_hart[n].stop, 1, __ATOMIC_RELAXED);
+}
+
+static inline void hart_check(CpuState *cs) {
+	Hart *h = emu_hart + cs->hart;
+	if (snap_request) {
+		snap_request = 0;
+		snap_save(cs);
+	}
+	if (__atomic_load_n(&h->stop, __ATOMIC_RELAXED)) {
+		hart_park(h, cs);
+	}
+}
+
+static uint32_t hart_rd(IoDevice *dev, CpuState *cs, uint32_t addr) {
+	switch (addr) {
+	case -4:
+		return cs->hart;
+	case -5:
+		return emu_harts;
+	case -6:
+		return __atomic_load_n(&hart_running, __ATOMIC_SEQ_CST);
+	}
 	return 0;
 }
 
-void io_wr32(CpuState *cs, uint32_t addr, uint32_t val) {
+static void hart_wr(IoDevice *dev, CpuState *cs, uint32_t addr, uint32_t val) {
+	Hart *h = emu_hart + cs->hart;
+	switch (addr) {
+	case -4:
+		h->start_pc = val;
+		break;
+	case -5:
+		h->start_arg = val;
+		break;
+	case -6:
+		hart_start(h, val);
+		break;
+	case -7:
+		hart_stop(h, cs, val);
+		break;
+	}
+}
+
+static IoDevice hart_dev = {
+	.name = "hart", .base = -7, .size = 4, .rd32 = hart_rd, .wr32 = hart_wr,
+};
+
+// Console
+//
+// stx -1 buffers one byte of output (to stderr), stx -9 flushes, and
+// stx -11 writes the number of bytes last written to stx -10 from
+// the guest address given, directly out of guest RAM.  The buffer
+// (-cb, 0 for none) is also flushed when a newline is written, when
+// it fills, and on exit.
+
+static uint8_t *con_buf;
+static uint32_t con_size = 4096;
+static uint32_t con_len;
+static pthread_mutex_t con_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void con_write(const void *data, uint32_t len) {
+	const uint8_t *p = data;
+	while (len > 0) {
+		ssize_t r = write(2, p, len);
+		if (r <= 0) break;
+		p += r;
+		len -= r;
+	}
+}
+
+static void con_flush_locked(void) {
+	con_write(con_buf, con_len);
+	con_len = 0;
+}
+
+void con_flush(void) {
+	pthread_mutex_lock(&con_lock);
+	con_flush_locked();
+	pthread_mutex_unlock(&con_lock);
+}
+
+static void con_putc(uint32_t c) {
+	pthread_mutex_lock(&con_lock);
+	con_buf[con_len++] = c;
+	if ((c == '\n') || (con_len >= con_size)) {
+		con_flush_locked();
+	}
+	pthread_mutex_unlock(&con_lock);
+}
+
+static void con_dma(uint32_t addr, uint32_t len) {
+	const uint8_t *data = mem_dma(addr, len);
+	if (data == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&con_lock);
+	if ((con_len + len) > con_size) {
+		con_flush_locked();
+	}
+	if (len >= con_size) {
+		con_write(data, len);
+	} else {
+		memcpy(con_buf + con_len, data, len);
+		con_len += len;
+		if (memchr(data, '\n', len)) {
+			con_flush_locked();
+		}
+	}
+	pthread_mutex_unlock(&con_lock);
+}
+
+static void con_init(void) {
+	// even unbuffered, con_putc() needs room for one byte
+	con_buf = malloc(con_size ? con_size : 1);
+	if (con_buf == NULL) {
+		fprintf(stderr, "emu: out of memory\n");
+		exit(1);
+	}
+	atexit(con_flush);
+}
+
+static void con_wr(IoDevice *dev, CpuState *cs, uint32_t addr, uint32_t val) {
+	Hart *h = emu_hart + cs->hart;
 	switch (addr) {
 	case -1:
-		uint8_t x = val;
-		if (write(2, &x, 1) != 1) ;
+		con_putc(val & 0xFF);
 		break;
-	case -2:
+	case -9:
+		con_flush();
 		break;
-	case -3:
-		if (val) {
-			fprintf(stderr, "%08x %08x %08x %08x\n",
-				cs->r[20], cs->r[21], cs->r[22], cs->r[23]);
-			fprintf(stderr, "FAIL: CODE: %08x\n", val);
-			exit(1);
+	case -10:
+		h->con_len = val;
+		break;
+	case -11:
+		con_dma(val, h->con_len);
+		break;
+	}
+}
+
+static IoDevice con_dev = {
+	.name = "console", .base = -1, .size = 1, .wr32 = con_wr,
+};
+static IoDevice con_bulk_dev = {
+	.name = "console bulk", .base = -11, .size = 3, .wr32 = con_wr,
+};
+
+// IO bus
+//
+// Devices sit in io_dev[] sorted by base address, and an access
+// finds its device by binary search.  The built-in devices are:
+//
+// -14 .. -12  timer (see timer-sr32.c)
+// -11 .. -9   console bulk write and flush
+//  -8         snapshot
+//  -7 .. -4   hart control
+//  -3         exit (value is the exit code)
+//  -2         debug (writes ignored)
+//  -1         console output
+
+#define IO_MAX 64
+
+static IoDevice *io_dev[IO_MAX];
+static uint32_t io_ndev;
+
+int (*emu_io_hook)(void *ctx, CpuState *s, int write, uint32_t addr, uint32_t *val);
+EMU_GUEST void *emu_io_ctx;
+void (*emu_stop_hook)(CpuState *s, uint32_t why, uint32_t val);
+
+static void exit_wr(IoDevice *dev, CpuState *cs, uint32_t addr, uint32_t val) {
+	if (vec_result) {
+		vec_result->code = val;
+		vec_result->done = 1;
+	}
+	con_flush();
+	if (emu_stop_hook) emu_stop_hook(cs, STOP_EXIT, val);
+	if (val) {
+		fprintf(stderr, "%08x %08x %08x %08x\n",
+			cs->r[20], cs->r[21], cs->r[22], cs->r[23]);
+		fprintf(stderr, "FAIL: CODE: %08x\n", val);
+		exit(1);
+	}
+	exit(0);
+}
+
+static IoDevice exit_dev = {
+	.name = "exit", .base = -3, .size = 1, .wr32 = exit_wr,
+};
+static IoDevice debug_dev = {
+	.name = "debug", .base = -2, .size = 1,
+};
+
+void io_register(IoDevice *dev) {
+	if ((dev->size == 0) || (io_ndev == IO_MAX)) {
+		fprintf(stderr, "emu: cannot register io device '%s'\n", dev->name);
+		exit(1);
+	}
+	uint32_t n = io_ndev;
+	while ((n > 0) && (io_dev[n - 1]->base > dev->base)) {
+		io_dev[n] = io_dev[n - 1];
+		n--;
+	}
+	io_dev[n] = dev;
+	io_ndev++;
+	IoDevice *prev = n ? io_dev[n - 1] : NULL;
+	IoDevice *next = (n + 1) < io_ndev ? io_dev[n + 1] : NULL;
+	if ((prev && ((dev->base - prev->base) < prev->size)) ||
+		(next && ((next->base - dev->base) < dev->size)) ||
+		((dev->base + (dev->size - 1)) < dev->base)) {
+		fprintf(stderr, "emu: io device '%s' overlaps another\n", dev->name);
+		exit(1);
+	}
+}
+
+static void io_init(void) {
+	io_register(&con_dev);
+	io_register(&con_bulk_dev);
+	io_register(&snap_dev);
+	io_register(&hart_dev);
+	io_register(&exit_dev);
+	io_register(&debug_dev);
+	timer_init();
+}
+
+// device decoding addr, or NULL
+static inline IoDevice *io_find(uint32_t addr) {
+	uint32_t lo = 0, hi = io_ndev;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (io_dev[mid]->base <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) return NULL;
+	IoDevice *dev = io_dev[lo - 1];
+	return ((addr - dev->base) < dev->size) ? dev : NULL;
+}
+
+uint32_t io_bus_rd32(CpuState *cs, uint32_t addr) {
+	hart_check(cs);
+	if (emu_io_hook) {
+		uint32_t val;
+		if (emu_io_hook(emu_io_ctx, cs, 0, addr, &val)) return val;
+	}
+	IoDevice *dev = io_find(addr);
+	if (dev && dev->rd32) {
+		return dev->rd32(dev, cs, addr);
+	}
+	return 0;
+}
+
+void io_bus_wr32(CpuState *cs, uint32_t addr, uint32_t val) {
+	hart_check(cs);
+	if (emu_io_hook && emu_io_hook(emu_io_ctx, cs, 1, addr, &val)) return;
+	IoDevice *dev = io_find(addr);
+	if (dev && dev->wr32) {
+		dev->wr32(dev, cs, addr, val);
+	}
+}
+
+uint32_t io_rd32(CpuState *cs, uint32_t addr) {
+	if (lockstep_mode) {
+		return lockstep_rd32(cs, addr);
+	}
+	return io_bus_rd32(cs, addr);
+}
+
+void io_wr32(CpuState *cs, uint32_t addr, uint32_t val) {
+	if (lockstep_mode) {
+		lockstep_wr32(cs, addr, val);
+	} else {
+		io_bus_wr32(cs, addr, val);
+	}
+}
+
+// Syscalls
+//
+// See syscall-sr32.h for the ABI.  Guest fds index sys_fd[], which
+// holds the host fd, so guests cannot reach the emulator's own files.
+// read and write go straight between the host fd and guest RAM.
+
+static int sys_fd_main[SYS_FD_MAX];
+static EMU_GUEST int *sys_fd = sys_fd_main;
+static pthread_mutex_t sys_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void sys_fds_init(int *fds) {
+	for (unsigned n = 0; n < SYS_FD_MAX; n++) {
+		fds[n] = (n < 3) ? n : -1;
+	}
+}
+
+void sys_fds_select(int *fds) {
+	sys_fd = fds;
+}
+
+static int sys_host_fd(uint32_t fd) {
+	return (fd < SYS_FD_MAX) ? sys_fd[fd] : -1;
+}
+
+// guest RAM written other than by mem_wr*() may hold code
+static void sys_invalidate(uint32_t addr, uint32_t len) {
+	if (lockstep_mode) lockstep_dirty(addr, len);
+	// 64 bits, as a range may end at the top of a 4GB RAM
+	uint64_t end = (uint64_t) addr + len;
+	uint64_t pos = addr;
+	while (pos < end) {
+		uint64_t next = (pos | (PAGESIZE - 1)) + 1;
+		if (next > end) next = end;
+		if (emu_codepage[pos >> PAGESHIFT]) {
+			for (uint64_t a = pos & (~3); a < next; a += 4) {
+				mem_invalidate(a);
+			}
 		}
-		exit(0);
+		pos = next;
 	}
 }
 
+static int32_t sys_open(uint32_t path, uint32_t flags, uint32_t mode) {
+	if (path >= emu_ram_size) return -EFAULT;
+	uint64_t max = emu_ram_size - path;
+	if (max > PATH_MAX) max = PATH_MAX;
+	if (memchr(emu_ram + path, 0, max) == NULL) return -ENAMETOOLONG;
+
+	int hflags;
+	switch (flags & 3) {
+	case SYS_O_RDONLY: hflags = O_RDONLY; break;
+	case SYS_O_WRONLY: hflags = O_WRONLY; break;
+	case SYS_O_RDWR: hflags = O_RDWR; break;
+	default: return -EINVAL;
+	}
+	if (flags & SYS_O_CREAT) hflags |= O_CREAT;
+	if (flags & SYS_O_TRUNC) hflags |= O_TRUNC;
+	if (flags & SYS_O_APPEND) hflags |= O_APPEND;
+
+	pthread_mutex_lock(&sys_lock);
+	int32_t fd;
+	for (fd = 0; fd < SYS_FD_MAX; fd++) {
+		if (sys_fd[fd] < 0) break;
+	}
+	if (fd == SYS_FD_MAX) {
+		fd = -EMFILE;
+	} else {
+		int hfd = open((char*) emu_ram + path, hflags | O_CLOEXEC, mode & 0777);
+		if (hfd < 0) {
+			fd = -errno;
+		} else {
+			sys_fd[fd] = hfd;
+		}
+	}
+	pthread_mutex_unlock(&sys_lock);
+	return fd;
+}
+
+static int32_t sys_close(uint32_t fd) {
+	int32_t r = 0;
+	pthread_mutex_lock(&sys_lock);
+	int hfd = sys_host_fd(fd);
+	if (hfd < 0) {
+		r = -EBADF;
+	} else {
+		sys_fd[fd] = -1;
+		// the emulator keeps using its own stdin/stdout/stderr
+		if ((hfd > 2) && close(hfd)) r = -errno;
+	}
+	pthread_mutex_unlock(&sys_lock);
+	return r;
+}
+
+static int32_t sys_read(uint32_t fd, uint32_t addr, uint32_t len) {
+	int hfd = sys_host_fd(fd);
+	if (hfd < 0) return -EBADF;
+	if (len > 0x7FFFFFFF) len = 0x7FFFFFFF;
+	void *buf = mem_dma(addr, len);
+	if (buf == NULL) return -EFAULT;
+	ssize_t r = read(hfd, buf, len);
+	if (r < 0) return -errno;
+	sys_invalidate(addr, r);
+	return r;
+}
+
+static int32_t sys_write(uint32_t fd, uint32_t addr, uint32_t len) {
+	int hfd = sys_host_fd(fd);
+	if (hfd < 0) return -EBADF;
+	if (len > 0x7FFFFFFF) len = 0x7FFFFFFF;
+	void *buf = mem_dma(addr, len);
+	if (buf == NULL) return -EFAULT;
+	// keep console output (on stderr) ordered with direct writes
+	if ((hfd == 1) || (hfd == 2)) con_flush();
+	ssize_t r = write(hfd, buf, len);
+	return (r < 0) ? -errno : r;
+}
+
+static int32_t sys_lseek(uint32_t fd, int32_t off, uint32_t whence) {
+	int hfd = sys_host_fd(fd);
+	if (hfd < 0) return -EBADF;
+	switch (whence) {
+	case SYS_SEEK_SET: whence = SEEK_SET; break;
+	case SYS_SEEK_CUR: whence = SEEK_CUR; break;
+	case SYS_SEEK_END: whence = SEEK_END; break;
+	default: return -EINVAL;
+	}
+	off_t r = lseek(hfd, off, whence);
+	if (r < 0) return -errno;
+	if (r > 0x7FFFFFFF) return -EOVERFLOW;
+	return r;
+}
+
+// Map file pages privately over guest RAM.  Pages of the range past
+// the end of the file are zeroed rather than mapped, since touching
+// them would fault.
+static int32_t sys_mmap(uint32_t addr, uint32_t len, uint32_t fd, uint32_t off) {
+	int hfd = sys_host_fd(fd);
+	if (hfd < 0) return -EBADF;
+	if ((addr | off) & (PAGESIZE - 1)) return -EINVAL;
+	len = (len + PAGESIZE - 1) & (~(PAGESIZE - 1));
+	if ((len == 0) || (mem_dma(addr, len) == NULL)) return -EINVAL;
+	struct stat st;
+	if (fstat(hfd, &st)) return -errno;
+	uint64_t avail = (st.st_size > off) ? (st.st_size - off) : 0;
+	avail = (avail + PAGESIZE - 1) & (~(PAGESIZE - 1));
+	uint32_t maplen = (avail < len) ? avail : len;
+	if (maplen && (mmap(emu_ram + addr, maplen, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_FIXED, hfd, off) == MAP_FAILED)) {
+		// the existing mapping is untouched on failure
+		return -errno;
+	}
+	if (maplen < len) {
+		emu_clear(emu_ram + addr + maplen, len - maplen);
+	}
+	sys_invalidate(addr, len);
+	return addr;
+}
+
+void sys_dispatch(CpuState *s, uint32_t n) {
+	uint32_t *a = (uint32_t*) (s->r + 10);
+	int32_t r;
+	hart_check(s);
+	switch (n) {
+	case SYS_OPEN:
+		r = sys_open(a[0], a[1], a[2]);
+		break;
+	case SYS_READ:
+		r = sys_read(a[0], a[1], a[2]);
+		break;
+	case SYS_WRITE:
+		r = sys_write(a[0], a[1], a[2]);
+		break;
+	case SYS_CLOSE:
+		r = sys_close(a[0]);
+		break;
+	case SYS_LSEEK:
+		r = sys_lseek(a[0], a[1], a[2]);
+		break;
+	case SYS_MMAP:
+		r = sys_mmap(a[0], a[1], a[2], a[3]);
+		break;
+	default:
+		r = -ENOSYS;
+		break;
+	}
+	s->r[10] = r;
+}
+
 void do_syscall(CpuState *s, uint32_t n) {
+	if (lockstep_mode) {
+		lockstep_syscall(s, n);
+	} else {
+		sys_dispatch(s, n);
+	}
 }
 
 void do_undef(CpuState *s, uint32_t ins) {
+	if (emu_stop_hook) {
+		con_flush();
+		emu_stop_hook(s, STOP_UNDEF, ins);
+	}
 	fprintf(stderr, "UNDEF INSTR (PC=%08x INS=%08x)\n", s->pc, ins);
 	exit(1);
 }
 
-void load_hex_image(const char* fn) {
+static int load_hex_image(const char* fn) {
 	char line[1024];
 	FILE *fp = fopen(fn, "r");
 	if (fp == NULL) {
 		fprintf(stderr, "emu: cannot open: %s\n", fn);
-		exit(1);
+		return -1;
 	}
 	while (fgets(line, sizeof(line), fp) != NULL) {
 		if ((line[0] == '#') || (line[0] == '/')) {
@@ -90,35 +826,546 @@ void load_hex_image(const char* fn) {
 		}
 	}
 	fclose(fp);
+	return 0;
+}
+
+// image symbols, sorted by address
+static ImageSymbol *emu_syms;
+static uint32_t emu_nsyms;
+static char *emu_symstr;
+
+const char *emu_symbol(uint32_t addr) {
+	uint32_t lo = 0, hi = emu_nsyms;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (emu_syms[mid].addr < addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if ((lo < emu_nsyms) && (emu_syms[lo].addr == addr)) {
+		return emu_symstr + emu_syms[lo].name;
+	}
+	return NULL;
+}
+
+#ifndef LIBSR32
+// for the profiler, which libsr32 does not offer
+static int sym_cmp(const void *_a, const void *_b) {
+	const ImageSymbol *a = _a;
+	const ImageSymbol *b = _b;
+	return (a->addr < b->addr) ? -1 : ((a->addr > b->addr) ? 1 : 0);
+}
+
+static void load_symbols(int fd, ImageHeader *hdr) {
+	size_t len = sizeof(ImageSymbol) * hdr->symcount;
+	free(emu_syms);
+	free(emu_symstr);
+	emu_nsyms = 0;
+	emu_syms = malloc(len + 1);
+	emu_symstr = malloc(hdr->strsize + 1);
+	if ((emu_syms == NULL) || (emu_symstr == NULL) ||
+		(pread(fd, emu_syms, len, hdr->symoff) != len) ||
+		(pread(fd, emu_symstr, hdr->strsize, hdr->symoff + len) != hdr->strsize)) {
+		// symbols are only informational
+		free(emu_syms);
+		free(emu_symstr);
+		emu_syms = NULL;
+		emu_symstr = NULL;
+		return;
+	}
+	emu_symstr[hdr->strsize] = 0;
+	for (uint32_t n = 0; n < hdr->symcount; n++) {
+		if (emu_syms[n].name >= hdr->strsize) {
+			emu_syms[n].name = hdr->strsize;
+		}
+	}
+	qsort(emu_syms, hdr->symcount, sizeof(ImageSymbol), sym_cmp);
+	emu_nsyms = hdr->symcount;
+}
+#endif
+
+// Load a binary image, or fall back to the hex format.
+// Returns 0 and the entry point, or -1 on error.
+int load_image(const char* fn, uint32_t *entry) {
+	ImageHeader hdr;
+	int fd = open(fn, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "emu: cannot open: %s\n", fn);
+		return -1;
+	}
+	if ((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+		(hdr.magic != IMAGE_MAGIC)) {
+		close(fd);
+		*entry = 0x100000;
+		return load_hex_image(fn);
+	}
+	if (hdr.version != IMAGE_VERSION) {
+		fprintf(stderr, "emu: unsupported image version %u: %s\n", hdr.version, fn);
+		close(fd);
+		return -1;
+	}
+	for (uint32_t n = 0; n < hdr.segcount; n++) {
+		ImageSegment seg;
+		if (pread(fd, &seg, sizeof(seg), sizeof(hdr) + n * sizeof(seg)) != sizeof(seg)) {
+			goto fail;
+		}
+		if ((seg.addr >= emu_ram_size) || (seg.memsz > (emu_ram_size - seg.addr)) ||
+			(seg.filesz > seg.memsz)) {
+			fprintf(stderr, "emu: segment %08x+%x outside ram: %s\n",
+				seg.addr, seg.memsz, fn);
+			close(fd);
+			return -1;
+		}
+		uint8_t *dst = emu_ram + seg.addr;
+		if (((seg.addr | seg.offset) & (IMAGE_ALIGN - 1)) == 0) {
+			// private file mapping directly over guest ram
+			size_t len = (seg.filesz + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+			if (len && (mmap(dst, len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, seg.offset) == MAP_FAILED)) {
+				goto fail;
+			}
+			// the last page may contain whatever follows in the file
+			memset(dst + seg.filesz, 0, len - seg.filesz);
+		} else {
+			if (pread(fd, dst, seg.filesz, seg.offset) != seg.filesz) {
+				goto fail;
+			}
+		}
+	}
+#ifndef LIBSR32
+	if (hdr.symcount) {
+		load_symbols(fd, &hdr);
+	}
+#endif
+	close(fd);
+	*entry = hdr.entry;
+	return 0;
+fail:
+	fprintf(stderr, "emu: cannot load image: %s\n", fn);
+	close(fd);
+	return -1;
+}
+
+// Place guest arguments on the stack below the exit stub and
+// set up the registers for entry.
+void emu_setup(CpuState *cs, uint32_t entry, int args, char **argv) {
+	uint32_t lr = entry - 16;
+	uint32_t sp = lr;
+
+	uint32_t guest_argc = args;
+	uint32_t guest_argv = 0;
+	if (args) {
+		sp -= (args + 1) * 4;
+		uint32_t p = sp;
+		guest_argv = p;
+		while (args > 0) {
+			uint32_t n = strlen(argv[0]) + 1;
+			sp -= (n + 3) & (~3);
+			for (uint32_t i = 0; i < n; i++) {
+				mem_wr8(sp + i, argv[0][i]);
+			}
+			mem_wr32(p, sp);
+			p += 4;
+			args--;
+			argv++;
+		}
+		mem_wr32(p, 0);
+	}
+
+	cs->pc = entry;
+	cs->r[1] = lr;
+	cs->r[2] = sp;
+	cs->r[10] = guest_argc;
+	cs->r[11] = guest_argv;
+}
+
+static void watchdog_fire(CpuState *s, void *ctx) {
+	con_flush();
+	fprintf(stderr, "emu: hart %u reached the %llu instruction limit\n",
+		s->hart, (unsigned long long) emu_max_insns);
+	exit(1);
+}
+
+// Run hart 0 from cs with core (plus the threads of any other harts).
+void emu_start(CpuState *cs, CoreFn core) {
+	emu_core = core;
+	hart_running = 1;
+	emu_hart[0].cs = *cs;
+	for (uint32_t n = 0; n < emu_harts; n++) {
+		emu_hart[n].cs.flags = cs->flags;
+		emu_hart[n].cs.hart = n;
+		if (emu_max_insns) {
+			sched_at(&emu_hart[n].cs, emu_max_insns, watchdog_fire, NULL);
+		}
+	}
+	for (uint32_t n = 1; n < emu_harts; n++) {
+		if (pthread_create(&emu_hart[n].thread, NULL, hart_main, emu_hart + n)) {
+			fprintf(stderr, "emu: cannot create hart thread\n");
+			exit(1);
+		}
+	}
+	hart_main(emu_hart + 0);
+}
+
+void emu_init(void) {
+	con_init();
+	io_init();
+	sys_fds_init(sys_fd_main);
+}
+
+#ifndef LIBSR32
+
+static void snap_signal(int sig) {
+	snap_request = 1;
+}
+
+// Restore guest memory and CpuState from a snapshot file,
+// allocating guest RAM at the size it was saved with.
+static void snap_load(const char *fn, CpuState *cs, int hugepages) {
+	SnapHeader hdr;
+	SnapPage pg;
+
+	FILE *fp = fopen(fn, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "emu: cannot open: %s\n", fn);
+		exit(1);
+	}
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+		(hdr.magic != SNAP_MAGIC) || (hdr.version != SNAP_VERSION)) {
+		fprintf(stderr, "emu: not a snapshot: %s\n", fn);
+		exit(1);
+	}
+	// a power of two from 64K to 4G, as parse_size() accepts
+	if ((hdr.ramsize < (64*1024)) || (hdr.ramsize > (4ULL*1024*1024*1024)) ||
+		(hdr.ramsize & (hdr.ramsize - 1))) {
+		fprintf(stderr, "emu: corrupt snapshot: %s\n", fn);
+		exit(1);
+	}
+	emu_ram_init(hdr.ramsize, hugepages);
+	for (uint32_t n = 0; n < hdr.pages; n++) {
+		if ((fread(&pg, sizeof(pg), 1, fp) != 1) ||
+			(pg.addr & (PAGESIZE - 1)) || (pg.addr >= emu_ram_size) ||
+			(fread(emu_ram + pg.addr, PAGESIZE, 1, fp) != 1)) {
+			fprintf(stderr, "emu: corrupt snapshot: %s\n", fn);
+			exit(1);
+		}
+	}
+	fclose(fp);
+	uint32_t flags = cs->flags;
+	*cs = hdr.cs;
+	cs->flags = flags;
+}
+
+// A store must not miss a page another hart is just starting to
+// predecode (see decode() in cpu-sr32-predecode.c), so with more
+// than one hart every page counts as code from the start.
+static void harts_code_init(CoreFn core) {
+	if ((emu_harts > 1) && (core == sr32core_predecode)) {
+		memset(emu_codepage, CODE_DECODED, emu_ram_size / PAGESIZE);
+	}
+}
+
+// Test vectors
+//
+// Each non-blank line of a vector file not starting with '#' is one
+// run of the loaded image, its whitespace separated fields appended
+// to the guest arguments.  Runs happen in forked children, up to
+// 'jobs' at a time, so each starts from a copy-on-write view of the
+// post-load guest memory (and the per-process engine state).  The
+// value a run writes to the exit port is passed back through a
+// shared mapping.
+
+#define VEC_MAXARGS 64
+
+static int run_vectors(CpuState *cs, uint32_t entry, const char *fn,
+		uint32_t jobs, int args, char **argv) {
+	char line[4096];
+	char **vec = NULL;
+	uint32_t *lineno = NULL;
+	uint32_t count = 0;
+	uint32_t n = 0;
+
+	FILE *fp = fopen(fn, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "emu: cannot open: %s\n", fn);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		n++;
+		char *x = line + strspn(line, " \t\r\n");
+		if ((*x == 0) || (*x == '#')) continue;
+		if ((count & 255) == 0) {
+			vec = realloc(vec, sizeof(char*) * (count + 256));
+			lineno = realloc(lineno, sizeof(uint32_t) * (count + 256));
+			if ((vec == NULL) || (lineno == NULL)) {
+				fprintf(stderr, "emu: out of memory\n");
+				return -1;
+			}
+		}
+		vec[count] = strdup(x);
+		lineno[count] = n;
+		count++;
+	}
+	fclose(fp);
+
+	VecResult *result = mmap(NULL, sizeof(VecResult) * (count + 1),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pid_t *pid = calloc(count + 1, sizeof(pid_t));
+	int *status = calloc(count + 1, sizeof(int));
+	if ((result == MAP_FAILED) || (pid == NULL) || (status == NULL)) {
+		fprintf(stderr, "emu: out of memory\n");
+		return -1;
+	}
+
+	uint32_t next = 0;
+	uint32_t active = 0;
+	while ((next < count) || (active > 0)) {
+		if ((next < count) && (active < jobs)) {
+			fflush(stdout);
+			fflush(stderr);
+			if ((pid[next] = fork()) < 0) {
+				fprintf(stderr, "emu: cannot fork\n");
+				return -1;
+			}
+			if (pid[next] == 0) {
+				char *xargv[VEC_MAXARGS];
+				int xargs = 0;
+				while ((xargs < args) && (xargs < VEC_MAXARGS)) {
+					xargv[xargs] = argv[xargs];
+					xargs++;
+				}
+				char *tok = strtok(vec[next], " \t\r\n");
+				while ((tok != NULL) && (xargs < VEC_MAXARGS)) {
+					xargv[xargs++] = tok;
+					tok = strtok(NULL, " \t\r\n");
+				}
+				vec_result = result + next;
+				emu_setup(cs, entry, xargs, xargv);
+				emu_start(cs, emu_core);
+				_exit(1);
+			}
+			next++;
+			active++;
+			continue;
+		}
+		int st;
+		pid_t done = wait(&st);
+		if (done < 0) break;
+		for (uint32_t i = 0; i < next; i++) {
+			if (pid[i] == done) {
+				status[i] = st;
+				active--;
+				break;
+			}
+		}
+	}
+
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (result[i].done) {
+			if (result[i].code == 0) continue;
+			fprintf(stderr, "vector %u (line %u): FAIL: CODE: %08x\n",
+				i, lineno[i], result[i].code);
+		} else if (WIFSIGNALED(status[i])) {
+			fprintf(stderr, "vector %u (line %u): FAIL: SIGNAL %d\n",
+				i, lineno[i], WTERMSIG(status[i]));
+		} else {
+			fprintf(stderr, "vector %u (line %u): FAIL: NO EXIT\n",
+				i, lineno[i]);
+		}
+		failed++;
+	}
+	fprintf(stderr, "%u vectors, %u passed, %u failed\n",
+		count, count - failed, failed);
+	return failed ? 1 : 0;
+}
+
+// Run statistics (-si): guest instructions retired by all harts,
+// host time, and their ratio, as one line of name=value fields.
+
+static struct timespec stats_start;
+static uint64_t stats_base;
+
+static uint64_t stats_insns(void) {
+	uint64_t n = 0;
+	for (uint32_t h = 0; h < emu_harts; h++) {
+		n += sched_now(&emu_hart[h].cs);
+	}
+	return n;
+}
+
+static void stats_report(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double secs = (now.tv_sec - stats_start.tv_sec) +
+		(now.tv_nsec - stats_start.tv_nsec) / 1e9;
+	uint64_t insns = stats_insns() - stats_base;
+	con_flush();
+	fprintf(stderr, "stats: insns=%llu seconds=%.6f mips=%.2f\n",
+		(unsigned long long) insns, secs, secs ? (insns / secs / 1e6) : 0.0);
+}
+
+// base: instructions hart 0 retired before this run (in a snapshot)
+static void stats_init(uint64_t base) {
+	stats_base = base;
+	clock_gettime(CLOCK_MONOTONIC, &stats_start);
+	atexit(stats_report);
+}
+
+// parse a RAM size: a power of two from 64K to 4G with optional K, M, G suffix
+static uint64_t parse_size(const char *s) {
+	char *end;
+	uint64_t n = strtoull(s, &end, 0);
+	switch (*end) {
+	case 'k': case 'K': n <<= 10; end++; break;
+	case 'm': case 'M': n <<= 20; end++; break;
+	case 'g': case 'G': n <<= 30; end++; break;
+	}
+	if ((*end != 0) || (n < (64*1024)) || (n > (4ULL*1024*1024*1024)) || (n & (n - 1))) {
+		fprintf(stderr, "emu: invalid ram size: %s\n", s);
+		exit(1);
+	}
+	return n;
 }
 
 void usage(int status) {
 	fprintf(stderr,
-		"usage:    emu <options> <image.hex> <arguments>\n"
-		"options: -x <datafile>     Load Test Vector Data\n"
+		"usage:    emu <options> <image> <arguments>\n"
+		"options: -x <datafile>     Run Once per Line of Test Vector Data\n"
+		"         -j <jobs>         Parallel Test Vector Runs (default: cpu count)\n"
+		"         -e <engine>       Execution Engine (ref, predecode, blocks, jit, aot)\n"
+		"         -m <size>[K|M|G]  Guest RAM Size (power of two, default 8M, max 4G)\n"
+		"         -hp               Back Guest RAM with Transparent Huge Pages\n"
+		"         -n <harts>        Number of Harts (default 1, max 32)\n"
+		"         -cb <bytes>       Console Buffer Size (default 4096, 0 for none)\n"
+		"         -snap <file>      Snapshot File (default emu.snap)\n"
+		"         -restore <file>   Resume from Snapshot (instead of <image>)\n"
+		"         -sb               Block Statistics on Exit (blocks engine)\n"
+		"         -si               Instructions, Host Time, and MIPS on Exit\n"
+		"         -lockstep         Check the Engine against ref at Every Block\n"
+		"         -max-insns <n>    Stop Any Hart Retiring n Instructions\n"
+		"         -p                Profile Instructions and Calls (ref engine)\n"
 		"         -tf               Trace Instruction Fetches\n"
 		"         -tr               Trace Register Writes\n"
 		"         -tb               Trace Branches\n"
-		"         -ti               Trace IO Reads & Writes\n");
+		"         -ti               Trace IO Reads & Writes\n"
+		"         -tx <file>        Write Fetch & Register Traces in Binary\n"
+		"                           (all of both unless -tf or -tr given)\n");
 	exit(status);
 }
 
 int main(int argc, char** argv) {
-	uint32_t entry = 0x100000;
+	uint32_t entry;
 	const char* fn = NULL;
 	int args = 0;
+	CoreFn core = sr32core;
+	BlockFn step = NULL;
+	const char *engine = "ref";
+	int lockstep = 0;
+	int stats = 0;
+	int runstats = 0;
+	uint64_t ramsize = RAMSIZE_DEFAULT;
+	int hugepages = 0;
+	const char *vectors = NULL;
+	const char *restore = NULL;
+	const char *tracefile = NULL;
+	uint32_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
 
 	CpuState cs;
 	memset(&cs, 0, sizeof(cs));
-	memset(emu_ram, 0, sizeof(emu_ram));
 
 	while (argc > 1) {
-		if (!strcmp(argv[1], "-tf")) {
+		if (!strcmp(argv[1], "-e")) {
+			if (argc < 3) usage(1);
+			engine = argv[2];
+			if (!strcmp(argv[2], "ref")) {
+				core = sr32core;
+				step = NULL;
+			} else if (!strcmp(argv[2], "predecode")) {
+				core = sr32core_predecode;
+				step = sr32block_predecode;
+			} else if (!strcmp(argv[2], "blocks")) {
+				core = sr32core_blocks;
+				step = sr32block_blocks;
+			} else if (!strcmp(argv[2], "jit")) {
+				core = sr32core_jit;
+				step = sr32block_jit;
+			} else if (!strcmp(argv[2], "aot")) {
+				core = sr32core_aot;
+				step = NULL;
+			} else {
+				fprintf(stderr, "emu: unknown engine: %s\n", argv[2]);
+				return -1;
+			}
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-m")) {
+			if (argc < 3) usage(1);
+			ramsize = parse_size(argv[2]);
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-x")) {
+			if (argc < 3) usage(1);
+			vectors = argv[2];
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-j")) {
+			if (argc < 3) usage(1);
+			jobs = strtoul(argv[2], 0, 0);
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-max-insns")) {
+			if (argc < 3) usage(1);
+			emu_max_insns = strtoull(argv[2], 0, 0);
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-n")) {
+			if (argc < 3) usage(1);
+			emu_harts = strtoul(argv[2], 0, 0);
+			if ((emu_harts < 1) || (emu_harts > HART_MAX)) {
+				fprintf(stderr, "emu: invalid hart count: %s\n", argv[2]);
+				return -1;
+			}
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-snap")) {
+			if (argc < 3) usage(1);
+			snap_file = argv[2];
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-restore")) {
+			if (argc < 3) usage(1);
+			restore = argv[2];
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-cb")) {
+			if (argc < 3) usage(1);
+			con_size = strtoul(argv[2], 0, 0);
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[1], "-hp")) {
+			hugepages = 1;
+		} else if (!strcmp(argv[1], "-sb")) {
+			stats = 1;
+		} else if (!strcmp(argv[1], "-si")) {
+			runstats = 1;
+		} else if (!strcmp(argv[1], "-lockstep")) {
+			lockstep = 1;
+		} else if (!strcmp(argv[1], "-p")) {
+			cs.flags |= F_PROFILE;
+		} else if (!strcmp(argv[1], "-tf")) {
 			cs.flags |= F_TRACE_FETCH;
 		} else if (!strcmp(argv[1], "-tr")) {
 			cs.flags |= F_TRACE_REGS;
 		} else if (!strcmp(argv[1], "-tb")) {
 			cs.flags |= F_TRACE_BRANCH;
+		} else if (!strcmp(argv[1], "-tx")) {
+			if (argc < 3) usage(1);
+			tracefile = argv[2];
+			argc--;
+			argv++;
 		} else if (!strcmp(argv[1], "-ti")) {
 			cs.flags |= F_TRACE_IO;
 		} else if (argv[1][0] == '-') {
@@ -134,42 +1381,111 @@ int main(int argc, char** argv) {
 		argc--;
 		argv++;
 	}
-	if (fn == NULL) {
+	if ((fn == NULL) && (restore == NULL)) {
 		usage(1);
 	}
+	if (tracefile) {
+		if (!(cs.flags & (F_TRACE_FETCH | F_TRACE_REGS))) {
+			cs.flags |= F_TRACE_FETCH | F_TRACE_REGS;
+		}
+		cs.flags |= F_TRACE_BIN;
+	}
+	if (restore && (fn || vectors || (emu_harts > 1))) {
+		fprintf(stderr, "emu: -restore takes no image, -x, or -n\n");
+		return -1;
+	}
+	if (jobs < 1) {
+		jobs = 1;
+	}
+	if (cs.flags && (core != sr32core)) {
+		fprintf(stderr, "emu: tracing and profiling require the ref engine\n");
+		return -1;
+	}
+	if ((cs.flags & F_PROFILE) && ((emu_harts > 1) || vectors)) {
+		fprintf(stderr, "emu: profiling requires a single hart and no -x\n");
+		return -1;
+	}
+	if (tracefile && ((emu_harts > 1) || vectors)) {
+		fprintf(stderr, "emu: binary tracing requires a single hart and no -x\n");
+		return -1;
+	}
+	if ((emu_harts > 1) && (core != sr32core) && (core != sr32core_predecode) &&
+		(core != sr32core_aot)) {
+		fprintf(stderr, "emu: multiple harts require the ref, predecode, or aot engine\n");
+		return -1;
+	}
+	if (stats) {
+		if (core != sr32core_blocks) {
+			fprintf(stderr, "emu: block statistics require the blocks engine\n");
+			return -1;
+		}
+		atexit(blocks_stats);
+	}
+	if (runstats && vectors) {
+		fprintf(stderr, "emu: -si requires no -x\n");
+		return -1;
+	}
+	if (lockstep) {
+		if (step == NULL) {
+			fprintf(stderr, "emu: -lockstep requires the predecode, blocks, or jit engine\n");
+			return -1;
+		}
+		if ((emu_harts > 1) || vectors) {
+			fprintf(stderr, "emu: -lockstep requires a single hart and no -x\n");
+			return -1;
+		}
+		lockstep_engine(engine, step);
+		core = lockstep_core;
+	}
 
-	load_hex_image(fn);
+	signal(SIGUSR1, snap_signal);
+	emu_init();
+	if (core == sr32core) {
+		core = sr32core_select(cs.flags);
+	}
+	emu_core = core;
+	if (restore) {
+		snap_load(restore, &cs, hugepages);
+		if (cs.flags & F_PROFILE) {
+			prof_init(cs.pc);
+		}
+		if (tracefile) {
+			trace_open(tracefile, cs.pc);
+		}
+		harts_code_init(core);
+		if (runstats) {
+			stats_init(sched_now(&cs));
+		}
+		emu_start(&cs, core);
+		return 0;
+	}
 
-	uint32_t sp = entry - 16;
-	uint32_t lr = sp;
-	mem_wr32(lr + 0, 0xfffd002b);
+	emu_ram_init(ramsize, hugepages);
+	if (load_image(fn, &entry)) {
+		return 1;
+	}
 
-	uint32_t guest_argc = args;
-	uint32_t guest_argv = 0;
-	if (args) {
-		sp -= (args + 1) * 4;
-		uint32_t p = sp;
-		guest_argv = p;
-		while (args > 0) {
-			uint32_t n = strlen(argv[0]) + 1;
-			sp -= (n + 3) & (~3);
-			for (uint32_t i = 0; i < n; i++) {
-				mem_wr8(sp + i, argv[0][i]);
-			}
-			mem_wr32(p, sp);
-			p += 4;
-			args--;
-			argv++;
-		}
-		mem_wr32(p, 0);
+	// return address for the entry point: stx r0 to the exit port
+	mem_wr32(entry - 16, 0xfffd002b);
+
+	if (cs.flags & F_PROFILE) {
+		prof_init(entry);
+	}
+	if (tracefile) {
+		trace_open(tracefile, entry);
 	}
 
-	cs.pc = entry;
-	cs.r[1] = lr;
-	cs.r[2] = sp;
-	cs.r[10] = guest_argc;
-	cs.r[11] = guest_argv;
+	harts_code_init(core);
 
-	sr32core(&cs);
+	if (vectors) {
+		return run_vectors(&cs, entry, vectors, jobs, args, argv);
+	}
+	if (runstats) {
+		stats_init(sched_now(&cs));
+	}
+	emu_setup(&cs, entry, args, argv);
+	emu_start(&cs, core);
 	return 0;
 }
+
+#endif
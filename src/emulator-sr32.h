@@ -4,18 +4,96 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
+
+#include <trace-sr32.h>
 
 typedef struct {
 	int32_t r[32];
 	uint32_t pc;
 	uint32_t xpc;
 	uint32_t flags;
+	uint32_t hart;
+	int32_t countdown;	// instructions until sched_run() is due
+	uint32_t period;	// countdown as last set by the scheduler
+	uint64_t icount;	// instructions retired when it was set
 } CpuState;
 
 #define F_TRACE_FETCH 1
 #define F_TRACE_REGS  2
 #define F_TRACE_BRANCH 4
 #define F_TRACE_IO 8
+#define F_PROFILE 16
+#define F_TRACE_BIN 32 // fetch and register traces go to trace_*()
+#define F_LOCKSTEP 64  // only for the sr32block_ref() core instance
+
+#define RAMSIZE_DEFAULT (8*1024*1024)
+
+#define HART_MAX 32
+
+#define PAGESHIFT 12
+#define PAGESIZE  (1 << PAGESHIFT)
+
+// State belonging to one guest.  bin/emu's harts share a single
+// guest, but libsr32 runs each Machine on whichever host thread
+// calls it, installing the Machine's state in that thread's copy.
+#ifdef LIBSR32
+#define EMU_GUEST __thread
+#else
+#define EMU_GUEST
+#endif
+
+// Guest RAM is a power of two in size (up to 4GB) and addresses
+// wrap modulo its size.  It and the tables that parallel it are
+// anonymous demand-zero mappings, so only touched pages use memory.
+extern EMU_GUEST uint8_t *emu_ram;
+extern EMU_GUEST uint64_t emu_ram_size;
+extern EMU_GUEST uint32_t emu_mask8;
+extern EMU_GUEST uint32_t emu_mask16;
+extern EMU_GUEST uint32_t emu_mask32;
+
+void emu_ram_init(uint64_t size, int hugepages);
+void *emu_alloc(uint64_t len);
+void *emu_alloc_try(uint64_t len);
+void emu_clear(void *p, uint64_t len);
+
+// Predecoded form of one guest word, kept in emu_dcode[] which
+// parallels emu_ram[] one entry per 32bit word.  An op of 0 means
+// the word has not been decoded (or was invalidated by a store).
+typedef struct {
+	uint8_t op;
+	uint8_t t;
+	uint8_t a;
+	uint8_t b;
+	int32_t i;
+} DecodedIns;
+
+extern EMU_GUEST DecodedIns *emu_dcode;
+
+// DecodedIns handler indices
+enum {
+	PD_DECODE, PD_UNDEF, PD_NOP,
+	PD_ADDI, PD_SUBI, PD_ANDI, PD_ORI, PD_XORI, PD_SLLI, PD_SRLI, PD_SRAI,
+	PD_SLTI, PD_SLTUI, PD_MULI, PD_DIVI, PD_JALRI,
+	PD_ADD, PD_SUB, PD_AND, PD_OR, PD_XOR, PD_SLL, PD_SRL, PD_SRA,
+	PD_SLT, PD_SLTU, PD_MUL, PD_DIV, PD_JALR,
+	PD_AMOSWAP, PD_AMOADD, PD_AMOCAS,
+	PD_LDW, PD_LDH, PD_LDB, PD_LDX, PD_LI, PD_LDHU, PD_LDBU, PD_AUIPC,
+	PD_STW, PD_STH, PD_STB, PD_STX,
+	PD_BEQ, PD_BNE, PD_BLT, PD_BLTU, PD_BGE, PD_BGEU,
+	PD_JAL, PD_SYSCALL,
+	PD_EXIT, // block engine: leave block, continuing at the next word
+};
+
+void sr32decode(uint32_t ins, DecodedIns *d);
+
+// Nonzero for pages that contain predecoded or translated
+// instructions, which stores must invalidate.
+extern EMU_GUEST uint8_t *emu_codepage;
+
+#define CODE_DECODED 1
+#define CODE_JIT     2
+#define CODE_BLOCKS  4
 
 uint32_t mem_rd32(uint32_t addr);
 uint32_t mem_rd16(uint32_t addr);
@@ -24,10 +102,208 @@ void mem_wr32(uint32_t addr, uint32_t val);
 void mem_wr16(uint32_t addr, uint32_t val);
 void mem_wr8(uint32_t addr, uint32_t val);
 
+// pointer to len bytes of guest RAM at addr, or NULL if out of range
+void *mem_dma(uint32_t addr, uint32_t len);
+
+// atomic IR_AMO* op on the word at addr, returns the old value
+uint32_t mem_amo32(uint32_t op, uint32_t addr, uint32_t cmp, uint32_t val);
+
+// Cores set s->pc to the address of the next instruction before
+// calling io_rd32(), io_wr32(), or do_syscall().
 uint32_t io_rd32(CpuState *s, uint32_t addr);
 void io_wr32(CpuState *s, uint32_t addr, uint32_t val);
 
+// A device on the io bus decodes the ldx/stx addresses from base
+// to base + size - 1 (which may not wrap past 0xFFFFFFFF).  Its
+// callbacks get the full address accessed.  Either may be NULL:
+// reads then return 0 and writes are ignored, as for unclaimed
+// addresses.
+typedef struct IoDevice IoDevice;
+struct IoDevice {
+	const char *name;
+	uint32_t base;
+	uint32_t size;
+	uint32_t (*rd32)(IoDevice *dev, CpuState *s, uint32_t addr);
+	void (*wr32)(IoDevice *dev, CpuState *s, uint32_t addr, uint32_t val);
+	void *ctx;
+};
+
+// add a device to the bus (before any hart starts)
+void io_register(IoDevice *dev);
+
+// the bus itself, bypassing lockstep
+uint32_t io_bus_rd32(CpuState *s, uint32_t addr);
+void io_bus_wr32(CpuState *s, uint32_t addr, uint32_t val);
+
+// programmable timer device (ldx/stx -14 .. -12)
+void timer_init(void);
+void timer_reset(CpuState *s);
+
+// Timer and scheduler state lives in per-hart tables.  A host
+// running several guests (libsr32) allocates a set for each and
+// selects it on the thread about to run that guest (NULL selects
+// the emulator's own).  timer_new() and sched_new() return NULL if
+// out of memory.
+void *timer_new(uint32_t harts);
+void timer_select(void *t);
+
+// When set, consulted before the devices on every ldx (write 0)
+// and stx (write 1).  Returns nonzero if it handled the access,
+// having stored the value read in *val.
+extern int (*emu_io_hook)(void *ctx, CpuState *s, int write, uint32_t addr, uint32_t *val);
+extern EMU_GUEST void *emu_io_ctx;
+
+// write out buffered console output
+void con_flush(void);
+
 void do_syscall(CpuState *s, uint32_t n);
+void sys_dispatch(CpuState *s, uint32_t n);
 void do_undef(CpuState *s, uint32_t ins);
 
+// guest file descriptor table, guest fd to host fd (or -1)
+#define SYS_FD_MAX 64
+
+void sys_fds_init(int *fds);
+void sys_fds_select(int *fds);
+
+// Why the guest stopped: a write to the exit port (val is the
+// value written), an undefined instruction (val is the word), or
+// every hart having stopped.  When emu_stop_hook is set it is told
+// first, and may longjmp() out instead of letting the emulator exit.
+#define STOP_EXIT  0
+#define STOP_UNDEF 1
+#define STOP_HALT  2
+
+extern void (*emu_stop_hook)(CpuState *s, uint32_t why, uint32_t val);
+
+// Event scheduler, one per hart, in units of that hart's retired
+// instructions.  Cores count instructions down in s->countdown at
+// block boundaries (branches, jumps, syscalls) and before ldx and
+// stx, and call sched_run() from block boundaries once it reaches
+// zero.  Events run on the hart that scheduled them, possibly late
+// by the length of a block, but identically from run to run.
+typedef void (*SchedFn)(CpuState *s, void *ctx);
+
+uint64_t sched_now(CpuState *s);
+void sched_at(CpuState *s, uint64_t when, SchedFn fn, void *ctx);
+void sched_cancel(CpuState *s, SchedFn fn, void *ctx);
+void sched_run(CpuState *s);
+void sched_reset(CpuState *s);
+void *sched_new(uint32_t harts);
+void sched_select(void *q);
+
+// account for the instructions from start up to end
+static inline void sched_count(CpuState *s, uint32_t start, uint32_t end) {
+	s->countdown -= (end - start) >> 2;
+}
+
+// as sched_count() at a block boundary
+static inline void sched_block(CpuState *s, uint32_t start, uint32_t end) {
+	s->countdown -= (end - start) >> 2;
+	if (s->countdown <= 0) sched_run(s);
+}
+
+typedef void (*CoreFn)(CpuState *s);
+
+void emu_init(void);
+
+// load an image into RAM, returning 0 and its entry point or -1
+int load_image(const char *fn, uint32_t *entry);
+
+// set up the stack, guest arguments, and registers for entry
+void emu_setup(CpuState *cs, uint32_t entry, int args, char **argv);
+
+// run the harts from cs, returning only through emu_stop_hook
+void emu_start(CpuState *cs, CoreFn core);
+
+// reference core specialized for the trace and profile flags
+CoreFn sr32core_select(uint32_t flags);
+
 void sr32core(CpuState *s);
+void sr32core_predecode(CpuState *s);
+void sr32core_jit(CpuState *s);
+void sr32core_blocks(CpuState *s);
+void sr32core_aot(CpuState *s);
+
+// translated image (from bin/aot), runs from s->pc until it leaves
+// translated code, with s->pc where it did
+void sr32aot_run(CpuState *s);
+
+// Run one block, leaving s->pc at its successor.  Returns nonzero
+// if execution stopped on an undefined instruction.
+typedef int (*BlockFn)(CpuState *s);
+
+int sr32block_ref(CpuState *s);
+int sr32block_predecode(CpuState *s);
+int sr32block_blocks(CpuState *s);
+int sr32block_jit(CpuState *s);
+
+// As sr32block_predecode(), but stopping after at most left
+// instructions, within the block if need be.  Returns 1 if the
+// block ended in a syscall (which has been done).
+int sr32slice_predecode(CpuState *s, uint32_t left);
+
+// Lockstep checking (-lockstep), see lockstep-sr32.c.  While the
+// reference runs, lockstep_mode is LOCKSTEP_RECORD and the io bus
+// and syscalls report to the lockstep_*() hooks.  While the engine
+// under test catches up it is LOCKSTEP_REPLAY and they are replayed.
+#define LOCKSTEP_RECORD 1
+#define LOCKSTEP_REPLAY 2
+
+extern int lockstep_mode;
+void lockstep_engine(const char *name, BlockFn step);
+void lockstep_core(CpuState *s);
+void lockstep_store(uint32_t addr);
+void lockstep_dirty(uint32_t addr, uint32_t len);
+uint32_t lockstep_rd32(CpuState *s, uint32_t addr);
+void lockstep_wr32(CpuState *s, uint32_t addr, uint32_t val);
+void lockstep_syscall(CpuState *s, uint32_t n);
+
+// name of the image symbol at addr, if any
+const char *emu_symbol(uint32_t addr);
+
+void sr32dis(uint32_t pc, uint32_t ins, char *out);
+
+// binary tracing to a ring buffer drained by a writer thread
+extern uint8_t *trace_ptr;
+extern uint8_t *trace_end;
+extern uint32_t trace_pc;
+void trace_open(const char *fn, uint32_t pc);
+void trace_next(void);
+
+static inline void trace_fetch(uint32_t pc, uint32_t ins) {
+	if ((trace_end - trace_ptr) < TR_MAXREC) trace_next();
+	uint8_t *p = trace_ptr;
+	if (pc == trace_pc) {
+		*p++ = TR_FETCH;
+	} else {
+		int32_t delta = pc - trace_pc;
+		uint32_t z = (((uint32_t) delta) << 1) ^ (delta >> 31);
+		*p++ = TR_JUMP;
+		while (z > 0x7F) {
+			*p++ = z | 0x80;
+			z >>= 7;
+		}
+		*p++ = z;
+	}
+	memcpy(p, &ins, 4);
+	trace_ptr = p + 4;
+	trace_pc = pc + 4;
+}
+
+static inline void trace_reg(uint32_t val, uint32_t n) {
+	if ((trace_end - trace_ptr) < TR_MAXREC) trace_next();
+	uint8_t *p = trace_ptr;
+	*p++ = TR_REG + n;
+	memcpy(p, &val, 4);
+	trace_ptr = p + 4;
+}
+
+// per-word execution counts, indexed by (pc & emu_mask32) >> 2
+extern uint64_t *prof_count;
+void prof_init(uint32_t entry);
+void prof_call(uint32_t from, uint32_t to);
+
+void jit_invalidate(uint32_t addr);
+void blocks_invalidate(uint32_t addr);
+void blocks_stats(void);
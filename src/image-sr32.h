@@ -0,0 +1,41 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#pragma once
+#include <stdint.h>
+
+// SR32 binary image
+//
+// An ImageHeader is followed by hdr.segcount ImageSegments.  Segment
+// data lives at IMAGE_ALIGN aligned file offsets so that loaders can
+// mmap it straight into guest memory.  Bytes from filesz to memsz are
+// zero.  The optional symbol table at hdr.symoff is hdr.symcount
+// ImageSymbols followed by the NUL terminated names they refer to.
+// All fields are little-endian.
+
+#define IMAGE_MAGIC   0x32335253 // "SR32"
+#define IMAGE_VERSION 1
+#define IMAGE_ALIGN   4096
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t segcount;
+	uint32_t symoff;
+	uint32_t symcount;
+	uint32_t strsize;	// bytes of names following the symbols
+	uint32_t reserved;
+} ImageHeader;
+
+typedef struct {
+	uint32_t addr;
+	uint32_t offset;	// file offset of data
+	uint32_t filesz;
+	uint32_t memsz;
+} ImageSegment;
+
+typedef struct {
+	uint32_t addr;
+	uint32_t name;		// offset of name from end of symbols
+} ImageSymbol;
@@ -0,0 +1,62 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#pragma once
+
+// The emulator as a library (bin/libsr32.a)
+//
+// A Machine owns its guest RAM, guest file descriptors, device
+// callback, and exit status.  Guest exits and faults come back
+// from sr32_run() as return codes instead of ending the process.
+//
+// Machines are independent: any number may run at once, each on
+// its own host thread.  A Machine may move between threads from
+// one call to the next, but must not be used by two at once.
+// Console output (ldx/stx -1, -9 .. -11) from all of them goes to
+// the process's stderr unless the device callback claims it.
+
+#include <emulator-sr32.h>
+
+typedef struct Machine Machine;
+
+// sr32_run() results
+#define SR32_EXIT  STOP_EXIT	// guest wrote to the exit port
+#define SR32_UNDEF STOP_UNDEF	// undefined instruction
+#define SR32_HALT  STOP_HALT	// every hart stopped
+#define SR32_LIMIT 3		// sr32_run_for() used up its instructions
+#define SR32_SYSCALL 4		// sr32_run_for() stopped after a syscall
+
+// Device callback, consulted before the built in devices on every
+// ldx (write 0) and stx (write 1).  Returns nonzero if it handled
+// the access, having stored the value read in *val.
+typedef int (*Sr32IoFn)(void *ctx, Machine *m, int write, uint32_t addr, uint32_t *val);
+
+// ramsize must be a power of two from 64K to 4G, or 0 for the default.
+// Returns NULL if it is not, or if the Machine cannot be allocated.
+Machine *sr32_create(uint64_t ramsize);
+
+// Load an image (binary or hex) and pass it argc arguments, in
+// place of anything loaded before: RAM starts out zeroed and the
+// last guest's files are closed.  Returns 0, or -1 if it cannot
+// be loaded.
+int sr32_load(Machine *m, const char *image, int argc, char **argv);
+
+void sr32_set_io(Machine *m, Sr32IoFn fn, void *ctx);
+
+// Run until the guest stops, returning one of SR32_*.  Running a
+// stopped Machine again returns the same result.
+int sr32_run(Machine *m);
+
+// Run for at most insns instructions, or until just after the
+// guest makes a syscall, with the pc and registers then in the
+// CpuState.  Returns SR32_LIMIT or SR32_SYSCALL if the guest may
+// continue (with a later sr32_run() or sr32_run_for()), else as
+// sr32_run().
+int sr32_run_for(Machine *m, uint64_t insns);
+
+// value written to the exit port, or the undefined instruction
+uint32_t sr32_exit_code(Machine *m);
+
+CpuState *sr32_cpu(Machine *m);
+
+void sr32_destroy(Machine *m);
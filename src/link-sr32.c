@@ -0,0 +1,355 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// SR32 linker: gathers each section of the objects from bin/asm in
+// turn, text from the base address and each following section from
+// the next IMAGE_ALIGN boundary (as bin/asm places them), resolves
+// their fixups, and writes an image whose entry point is the start
+// of the first object's text.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "image-sr32.h"
+#include "object-sr32.h"
+
+typedef struct Object Object;
+typedef struct Global Global;
+
+struct Object {
+	const char *fn;
+	ObjectHeader hdr;
+	uint8_t *data[SECTION_COUNT];
+	ObjectSymbol *syms;
+	ObjectFixup *fixups;
+	char *strs;
+	uint32_t base[SECTION_COUNT];
+};
+
+struct Global {
+	Global *next;
+	const char *name;
+	Object *obj;
+	uint32_t value;
+};
+
+static Object *objs;
+static unsigned nobjs;
+
+static Global **globals;
+static unsigned nglobals;	// buckets, a power of two
+
+static const char *secname[SECTION_COUNT] = { ".text", ".rodata", ".data", ".bss" };
+
+// the linked sections
+static uint8_t *secdata[SECTION_COUNT];
+static uint32_t secbase[SECTION_COUNT];
+static uint32_t secsize[SECTION_COUNT];
+
+static uint32_t image_base = 0x100000;
+
+void die(const char *fmt, ...) {
+	va_list ap;
+	fprintf(stderr, "ld: ");
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void *alloc(size_t len) {
+	void *p = malloc(len ? len : 1);
+	if (p == NULL) die("out of memory");
+	return p;
+}
+
+static void read_object(Object *o, const char *fn) {
+	FILE *fp = fopen(fn, "r");
+	if (fp == NULL) die("cannot open '%s'", fn);
+	o->fn = fn;
+	if ((fread(&o->hdr, sizeof(o->hdr), 1, fp) != 1) ||
+		(o->hdr.magic != OBJECT_MAGIC)) {
+		die("not an object file: '%s'", fn);
+	}
+	if (o->hdr.version != OBJECT_VERSION) {
+		die("unsupported object version %u: '%s'", o->hdr.version, fn);
+	}
+	for (unsigned n = 0; n < SECTION_COUNT; n++) {
+		if (o->hdr.size[n] & 3) die("misaligned object: '%s'", fn);
+		if (n == SECTION_BSS) continue;
+		o->data[n] = alloc(o->hdr.size[n]);
+		if (fread(o->data[n], 1, o->hdr.size[n], fp) != o->hdr.size[n]) {
+			die("truncated object: '%s'", fn);
+		}
+	}
+	o->syms = alloc(sizeof(ObjectSymbol) * o->hdr.symcount);
+	o->fixups = alloc(sizeof(ObjectFixup) * o->hdr.fixcount);
+	o->strs = alloc(o->hdr.strsize + 1);
+	if ((fread(o->syms, sizeof(ObjectSymbol), o->hdr.symcount, fp) != o->hdr.symcount) ||
+		(fread(o->fixups, sizeof(ObjectFixup), o->hdr.fixcount, fp) != o->hdr.fixcount) ||
+		(fread(o->strs, 1, o->hdr.strsize, fp) != o->hdr.strsize)) {
+		die("truncated object: '%s'", fn);
+	}
+	o->strs[o->hdr.strsize] = 0;
+	fclose(fp);
+	for (unsigned n = 0; n < o->hdr.symcount; n++) {
+		if ((o->syms[n].name >= o->hdr.strsize) ||
+			(o->syms[n].section >= SECTION_COUNT)) {
+			die("corrupt symbol table: '%s'", fn);
+		}
+	}
+	for (unsigned n = 0; n < o->hdr.fixcount; n++) {
+		ObjectFixup *f = o->fixups + n;
+		uint32_t len = (f->type == TYPE_ABS_HILO) || (f->type == TYPE_PCREL_HILO) ? 8 : 4;
+		if ((f->sym >= o->hdr.symcount) || (f->offset & 3) ||
+			(f->section >= SECTION_BSS) || (f->offset > o->hdr.size[f->section]) ||
+			((o->hdr.size[f->section] - f->offset) < len)) {
+			die("corrupt fixup: '%s'", fn);
+		}
+	}
+}
+
+static unsigned hash(const char *name) {
+	unsigned h = 2166136261u;
+	while (*name) {
+		h = (h ^ (unsigned char) *name++) * 16777619u;
+	}
+	return h;
+}
+
+static Global *find_global(const char *name) {
+	Global *g = globals[hash(name) & (nglobals - 1)];
+	for (; g; g = g->next) {
+		if (!strcmp(g->name, name)) return g;
+	}
+	return NULL;
+}
+
+// the final address or value of a symbol defined in o
+static uint32_t sym_value(Object *o, ObjectSymbol *s) {
+	return (s->flags & SYM_ABS) ? s->value : (o->base[s->section] + s->value);
+}
+
+static void add_globals(void) {
+	unsigned count = 0;
+	for (unsigned i = 0; i < nobjs; i++) {
+		count += objs[i].hdr.symcount;
+	}
+	nglobals = 1024;
+	while (nglobals < count) nglobals *= 2;
+	globals = calloc(nglobals, sizeof(Global*));
+	if (globals == NULL) die("out of memory");
+	for (unsigned i = 0; i < nobjs; i++) {
+		Object *o = objs + i;
+		for (unsigned n = 0; n < o->hdr.symcount; n++) {
+			ObjectSymbol *s = o->syms + n;
+			if ((s->flags & (SYM_DEFINED | SYM_GLOBAL)) != (SYM_DEFINED | SYM_GLOBAL)) {
+				continue;
+			}
+			const char *name = o->strs + s->name;
+			Global *g = find_global(name);
+			if (g) {
+				die("'%s' defined in both '%s' and '%s'", name, g->obj->fn, o->fn);
+			}
+			g = alloc(sizeof(Global));
+			g->name = name;
+			g->obj = o;
+			g->value = sym_value(o, s);
+			unsigned h = hash(name) & (nglobals - 1);
+			g->next = globals[h];
+			globals[h] = g;
+		}
+	}
+}
+
+static int is_signed16(uint32_t n) {
+	n &= 0xFFFF0000;
+	return ((n == 0) || (n == 0xFFFF0000));
+}
+static int is_signed21(uint32_t n) {
+	n &= 0xFFFFF800;
+	return ((n == 0) || (n == 0xFFFFF800));
+}
+
+static uint32_t rd32(unsigned sec, uint32_t addr) {
+	return *((uint32_t*) (secdata[sec] + addr - secbase[sec]));
+}
+static void wr32(unsigned sec, uint32_t addr, uint32_t val) {
+	*((uint32_t*) (secdata[sec] + addr - secbase[sec])) = val;
+}
+
+// as the assembler does for labels it can resolve itself
+static void do_fixup(Object *o, const char *name, unsigned sec, uint32_t addr,
+		uint32_t tgt, uint32_t type) {
+	uint32_t n = tgt;
+	switch (type) {
+	case TYPE_PCREL_S16:
+		n = n - (addr + 4);
+		if (!is_signed16(n)) goto oops;
+		wr32(sec, addr, rd32(sec, addr) | (n << 16));
+		break;
+	case TYPE_PCREL_S21:
+		n = n - (addr + 4);
+		if (!is_signed21(n)) goto oops;
+		wr32(sec, addr, rd32(sec, addr) | (n << 11));
+		break;
+	case TYPE_ABS_U32:
+		wr32(sec, addr, n);
+		break;
+	case TYPE_PCREL_HILO:
+		n = n - (addr + 4);
+	case TYPE_ABS_HILO:
+		uint32_t hi = n >> 16;
+		uint32_t lo = n & 0xffff;
+		if (lo & 0x8000) hi += 1;
+		wr32(sec, addr + 0, rd32(sec, addr + 0) | (hi << 16));
+		wr32(sec, addr + 4, rd32(sec, addr + 4) | (lo << 16));
+		break;
+	default:
+		die("unknown fixup type %u in '%s'", type, o->fn);
+	}
+	return;
+oops:
+	die("'%s' at %08x is out of range of %08x in '%s'", name, tgt, addr, o->fn);
+}
+
+static void link_object(Object *o) {
+	for (unsigned n = 0; n < SECTION_BSS; n++) {
+		memcpy(secdata[n] + o->base[n] - secbase[n], o->data[n], o->hdr.size[n]);
+	}
+	for (unsigned n = 0; n < o->hdr.fixcount; n++) {
+		ObjectFixup *f = o->fixups + n;
+		ObjectSymbol *s = o->syms + f->sym;
+		const char *name = o->strs + s->name;
+		uint32_t tgt;
+		if (s->flags & SYM_DEFINED) {
+			tgt = sym_value(o, s);
+		} else {
+			Global *g = find_global(name);
+			if (g == NULL) die("undefined symbol '%s' in '%s'", name, o->fn);
+			tgt = g->value;
+		}
+		do_fixup(o, name, f->section, o->base[f->section] + f->offset, tgt, f->type);
+	}
+}
+
+// one segment per section in use, bss taking no file space
+static void save_image(const char *fn) {
+	ImageHeader hdr;
+	ImageSegment seg[SECTION_COUNT];
+	unsigned segsec[SECTION_COUNT];
+	ImageSymbol sym;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = IMAGE_MAGIC;
+	hdr.version = IMAGE_VERSION;
+	hdr.entry = secbase[SECTION_TEXT];
+
+	uint32_t offset = IMAGE_ALIGN;
+	for (unsigned n = 0; n < SECTION_COUNT; n++) {
+		if (secsize[n] == 0) continue;
+		uint32_t filesz = (n == SECTION_BSS) ? 0 : secsize[n];
+		seg[hdr.segcount].addr = secbase[n];
+		seg[hdr.segcount].offset = offset;
+		seg[hdr.segcount].filesz = filesz;
+		seg[hdr.segcount].memsz = secsize[n];
+		offset = (offset + filesz + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+		segsec[hdr.segcount++] = n;
+	}
+
+	for (unsigned i = 0; i < nobjs; i++) {
+		Object *o = objs + i;
+		for (unsigned n = 0; n < o->hdr.symcount; n++) {
+			if (o->syms[n].flags & SYM_DEFINED) {
+				hdr.symcount++;
+				hdr.strsize += strlen(o->strs + o->syms[n].name) + 1;
+			}
+		}
+	}
+	hdr.symoff = hdr.segcount ?
+		(seg[hdr.segcount - 1].offset + seg[hdr.segcount - 1].filesz) : IMAGE_ALIGN;
+
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fwrite(seg, sizeof(seg[0]), hdr.segcount, fp);
+	for (uint32_t n = 0; n < hdr.segcount; n++) {
+		fseek(fp, seg[n].offset, SEEK_SET);
+		fwrite(secdata[segsec[n]], seg[n].filesz, 1, fp);
+	}
+	fseek(fp, hdr.symoff, SEEK_SET);
+	uint32_t name = 0;
+	for (unsigned i = 0; i < nobjs; i++) {
+		Object *o = objs + i;
+		for (unsigned n = 0; n < o->hdr.symcount; n++) {
+			ObjectSymbol *s = o->syms + n;
+			if (!(s->flags & SYM_DEFINED)) continue;
+			sym.addr = sym_value(o, s);
+			sym.name = name;
+			name += strlen(o->strs + s->name) + 1;
+			fwrite(&sym, sizeof(sym), 1, fp);
+		}
+	}
+	for (unsigned i = 0; i < nobjs; i++) {
+		Object *o = objs + i;
+		for (unsigned n = 0; n < o->hdr.symcount; n++) {
+			ObjectSymbol *s = o->syms + n;
+			if (!(s->flags & SYM_DEFINED)) continue;
+			fwrite(o->strs + s->name, strlen(o->strs + s->name) + 1, 1, fp);
+		}
+	}
+	if (fclose(fp)) die("error writing '%s'", fn);
+}
+
+int main(int argc, char **argv) {
+	const char *outname = "out.img";
+
+	while ((argc > 2) && (argv[1][0] == '-')) {
+		if (!strcmp(argv[1], "-o")) {
+			outname = argv[2];
+		} else if (!strcmp(argv[1], "-b")) {
+			image_base = strtoul(argv[2], 0, 0);
+			if (image_base & 3) die("misaligned base address");
+		} else {
+			die("unknown option '%s'", argv[1]);
+		}
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 2) {
+		die("usage: ld [ -o <out.img> ] [ -b <base> ] <file.o>...");
+	}
+
+	nobjs = argc - 1;
+	objs = calloc(nobjs, sizeof(Object));
+	if (objs == NULL) die("out of memory");
+	for (unsigned i = 0; i < nobjs; i++) {
+		read_object(objs + i, argv[i + 1]);
+	}
+	uint64_t addr = image_base;
+	for (unsigned n = 0; n < SECTION_COUNT; n++) {
+		if (n != SECTION_TEXT) {
+			addr = (addr + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+		}
+		secbase[n] = addr;
+		for (unsigned i = 0; i < nobjs; i++) {
+			objs[i].base[n] = addr;
+			addr += objs[i].hdr.size[n];
+		}
+		if (addr > 0x100000000ULL) die("%s does not fit below 4GB", secname[n]);
+		secsize[n] = addr - secbase[n];
+		if (n != SECTION_BSS) {
+			secdata[n] = alloc(secsize[n]);
+		}
+	}
+
+	add_globals();
+	for (unsigned i = 0; i < nobjs; i++) {
+		link_object(objs + i);
+	}
+	save_image(outname);
+	return 0;
+}
@@ -0,0 +1,290 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Lockstep checking of an execution engine against the reference (-lockstep)
+//
+// The reference core, one block at a time as sr32block_ref(), and
+// the engine selected with -e run the same program side by side.
+// The reference goes first, on its own copy of guest RAM (with its
+// own, always clear, code page flags, so that its stores do not
+// invalidate the engine's predecoded or translated code), doing
+// ldx, stx, and syscalls for real and logging what they returned
+// and which RAM the syscalls wrote.  The engine then runs until it
+// has retired as many instructions, replaying that log instead of
+// touching devices or host files.  Both must then agree on the
+// registers, the pc, and every word the reference stored to.  All
+// of resident RAM is compared every LS_FULL blocks as well, to
+// catch stray stores by the engine.
+//
+// At the first difference the block is disassembled, both states
+// are dumped, and the emulator exits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <emulator-sr32.h>
+
+#define LS_LOG_MAX   1024	// io operations per block
+#define LS_STORE_MAX 4096	// stores per block, beyond which RAM is compared
+#define LS_FULL      65536	// blocks between full RAM comparisons
+#define LS_DIS_MAX   32		// instructions disassembled on failure
+
+enum { LS_RD, LS_WR, LS_SYS, LS_MEM };
+
+typedef struct {
+	uint32_t kind;
+	uint32_t addr;		// io address, syscall number, or RAM address
+	uint32_t val;		// value read or written, syscall result, or length
+} LsEvent;
+
+int lockstep_mode;
+
+static const char *ls_name;
+static BlockFn ls_step;
+
+static CpuState ls_ref;
+static uint8_t *ls_ram;		// the reference's guest RAM
+static uint8_t *ls_codepage;	// and code page flags
+
+static LsEvent ls_log[LS_LOG_MAX];
+static uint32_t ls_nlog;
+static uint32_t ls_next;	// next entry to replay
+
+static uint32_t ls_store[LS_STORE_MAX];
+static uint32_t ls_nstore;
+
+static uint32_t ls_pc;		// start of the block being checked
+static uint64_t ls_count;	// instructions retired before it
+static uint64_t ls_blocks;
+
+void lockstep_engine(const char *name, BlockFn step) {
+	ls_name = name;
+	ls_step = step;
+}
+
+void lockstep_store(uint32_t addr) {
+	if (ls_nstore < LS_STORE_MAX) {
+		ls_store[ls_nstore] = addr;
+	}
+	ls_nstore++;
+}
+
+static void ls_describe(char *out, LsEvent *e) {
+	switch (e->kind) {
+	case LS_RD: sprintf(out, "ldx %08x", e->addr); break;
+	case LS_WR: sprintf(out, "stx %08x <- %08x", e->addr, e->val); break;
+	default: sprintf(out, "syscall %u", e->addr); break;
+	}
+}
+
+static void ls_fail(CpuState *s, const char *why) {
+	char dis[128];
+	fprintf(stderr, "lockstep: %s differs from ref: %s\n", ls_name, why);
+	fprintf(stderr, "block at %08x after %llu instructions:\n",
+		ls_pc, (unsigned long long) ls_count);
+	uint64_t n = sched_now(&ls_ref) - ls_count;
+	if (n > LS_DIS_MAX) n = LS_DIS_MAX;
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t pc = ls_pc + i * 4;
+		uint32_t ins = mem_rd32(pc);
+		sr32dis(pc, ins, dis);
+		fprintf(stderr, "  %08x: %08x  %s\n", pc, ins, dis);
+	}
+	fprintf(stderr, "             ref    %-8s\n", ls_name);
+	fprintf(stderr, "insns %10llu %10llu%s\n",
+		(unsigned long long) sched_now(&ls_ref),
+		(unsigned long long) sched_now(s),
+		(sched_now(&ls_ref) != sched_now(s)) ? "  *" : "");
+	fprintf(stderr, "pc      %08x   %08x%s\n", ls_ref.pc, s->pc,
+		(ls_ref.pc != s->pc) ? "  *" : "");
+	for (uint32_t r = 1; r < 32; r++) {
+		fprintf(stderr, "x%-2u     %08x   %08x%s\n", r, ls_ref.r[r], s->r[r],
+			(ls_ref.r[r] != s->r[r]) ? "  *" : "");
+	}
+	exit(1);
+}
+
+static uint32_t ls_record(uint32_t kind, uint32_t addr, uint32_t val) {
+	if (ls_nlog == LS_LOG_MAX) {
+		fprintf(stderr, "lockstep: more than %u io operations in one block\n",
+			LS_LOG_MAX);
+		exit(1);
+	}
+	LsEvent *e = ls_log + ls_nlog;
+	e->kind = kind;
+	e->addr = addr;
+	e->val = val;
+	return ls_nlog++;
+}
+
+// the next logged operation, which must be the engine's
+static LsEvent *ls_replay(CpuState *s, uint32_t kind, uint32_t addr, uint32_t val) {
+	LsEvent *e = ls_log + ls_next;
+	LsEvent want = { kind, addr, val };
+	if ((ls_next == ls_nlog) || (e->kind != kind) || (e->addr != addr) ||
+		((kind == LS_WR) && (e->val != val))) {
+		char a[64], b[64] = "nothing", why[160];
+		ls_describe(a, &want);
+		if (ls_next < ls_nlog) ls_describe(b, e);
+		snprintf(why, sizeof(why), "%s, ref did %s", a, b);
+		ls_fail(s, why);
+	}
+	ls_next++;
+	return e;
+}
+
+uint32_t lockstep_rd32(CpuState *s, uint32_t addr) {
+	if (lockstep_mode == LOCKSTEP_REPLAY) {
+		return ls_replay(s, LS_RD, addr, 0)->val;
+	}
+	uint32_t val = io_bus_rd32(s, addr);
+	ls_record(LS_RD, addr, val);
+	return val;
+}
+
+void lockstep_wr32(CpuState *s, uint32_t addr, uint32_t val) {
+	if (lockstep_mode == LOCKSTEP_REPLAY) {
+		ls_replay(s, LS_WR, addr, val);
+		return;
+	}
+	ls_record(LS_WR, addr, val);
+	io_bus_wr32(s, addr, val);
+}
+
+void lockstep_syscall(CpuState *s, uint32_t n) {
+	if (lockstep_mode == LOCKSTEP_REPLAY) {
+		s->r[10] = ls_replay(s, LS_SYS, n, 0)->val;
+		// bring over what the syscall wrote to RAM
+		while ((ls_next < ls_nlog) && (ls_log[ls_next].kind == LS_MEM)) {
+			LsEvent *e = ls_log + ls_next++;
+			for (uint32_t a = 0; a < e->val; a += 4) {
+				uint32_t addr = (e->addr + a) & emu_mask32;
+				mem_wr32(addr, *((uint32_t*) (ls_ram + addr)));
+			}
+		}
+		return;
+	}
+	uint32_t i = ls_record(LS_SYS, n, 0);
+	sys_dispatch(s, n);
+	ls_log[i].val = s->r[10];
+}
+
+void lockstep_dirty(uint32_t addr, uint32_t len) {
+	if (lockstep_mode == LOCKSTEP_RECORD) {
+		ls_record(LS_MEM, addr & (~3), len + (addr & 3));
+	}
+}
+
+static void ls_compare(CpuState *s) {
+	char msg[64];
+	if ((sched_now(&ls_ref) != sched_now(s)) || (ls_ref.pc != s->pc)) {
+		ls_fail(s, "control flow");
+	}
+	while (ls_next < ls_nlog) {
+		if (ls_log[ls_next].kind != LS_MEM) {
+			ls_describe(msg, ls_log + ls_next);
+			strcat(msg, " not done");
+			ls_fail(s, msg);
+		}
+		ls_next++;
+	}
+	for (uint32_t r = 1; r < 32; r++) {
+		if (ls_ref.r[r] != s->r[r]) {
+			sprintf(msg, "register x%u", r);
+			ls_fail(s, msg);
+		}
+	}
+}
+
+static void ls_compare_word(CpuState *s, uint32_t addr) {
+	char msg[80];
+	uint32_t a = *((uint32_t*) (ls_ram + addr));
+	uint32_t b = *((uint32_t*) (emu_ram + addr));
+	if (a != b) {
+		sprintf(msg, "memory at %08x (ref %08x, %s %08x)", addr, a, ls_name, b);
+		ls_fail(s, msg);
+	}
+}
+
+// compare every page resident in either copy of RAM
+static void ls_compare_ram(CpuState *s) {
+	uint64_t pages = emu_ram_size / PAGESIZE;
+	unsigned char *r0 = malloc(pages);
+	unsigned char *r1 = malloc(pages);
+	if ((r0 == NULL) || (r1 == NULL) ||
+		mincore(ls_ram, emu_ram_size, r0) || mincore(emu_ram, emu_ram_size, r1)) {
+		fprintf(stderr, "lockstep: cannot scan guest RAM\n");
+		exit(1);
+	}
+	for (uint64_t p = 0; p < pages; p++) {
+		if (!((r0[p] | r1[p]) & 1)) continue;
+		uint64_t off = p * PAGESIZE;
+		if (memcmp(ls_ram + off, emu_ram + off, PAGESIZE) == 0) continue;
+		for (uint64_t a = off; a < (off + PAGESIZE); a += 4) {
+			ls_compare_word(s, a);
+		}
+	}
+	free(r0);
+	free(r1);
+}
+
+static void ls_init(CpuState *s) {
+	ls_ram = emu_alloc(emu_ram_size);
+	ls_codepage = emu_alloc(emu_ram_size / PAGESIZE);
+	uint64_t pages = emu_ram_size / PAGESIZE;
+	unsigned char *resident = malloc(pages);
+	if ((resident == NULL) || mincore(emu_ram, emu_ram_size, resident)) {
+		fprintf(stderr, "lockstep: cannot scan guest RAM\n");
+		exit(1);
+	}
+	for (uint64_t p = 0; p < pages; p++) {
+		if (resident[p] & 1) {
+			memcpy(ls_ram + p * PAGESIZE, emu_ram + p * PAGESIZE, PAGESIZE);
+		}
+	}
+	free(resident);
+	ls_ref = *s;
+}
+
+void lockstep_core(CpuState *s) {
+	uint8_t *ram = emu_ram;
+	uint8_t *codepage = emu_codepage;
+	if (ls_ram == NULL) ls_init(s);
+	for (;;) {
+		ls_pc = s->pc;
+		ls_count = sched_now(s);
+		ls_nlog = 0;
+		ls_next = 0;
+		ls_nstore = 0;
+
+		lockstep_mode = LOCKSTEP_RECORD;
+		emu_ram = ls_ram;
+		emu_codepage = ls_codepage;
+		sr32block_ref(&ls_ref);
+		emu_ram = ram;
+		emu_codepage = codepage;
+
+		lockstep_mode = LOCKSTEP_REPLAY;
+		uint64_t end = sched_now(&ls_ref);
+		while (sched_now(s) < end) {
+			if (ls_step(s)) return;
+		}
+		lockstep_mode = 0;
+
+		ls_compare(s);
+		if ((ls_nstore > LS_STORE_MAX) || ((++ls_blocks % LS_FULL) == 0)) {
+			ls_compare_ram(s);
+		} else {
+			for (uint32_t n = 0; n < ls_nstore; n++) {
+				ls_compare_word(s, ls_store[n] & emu_mask32);
+			}
+		}
+
+		// only the reference runs scheduler events
+		s->countdown = ls_ref.countdown;
+		s->period = ls_ref.period;
+		s->icount = ls_ref.icount;
+	}
+}
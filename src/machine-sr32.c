@@ -0,0 +1,211 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Machine objects for libsr32.a
+//
+// A Machine holds its own guest RAM, predecode tables, file table,
+// timer, and event queue.  The emulator reaches a guest's state
+// through thread local pointers (EMU_GUEST in emulator-sr32.h in
+// this build), so each call installs its Machine (machine_select())
+// in the calling thread's copies.  Machines on different threads
+// thus run at once, and slices of different machines interleave.
+// They run the predecode engine on a single hart, on m->cs.
+//
+// The stop hook records why the guest stopped and longjmp()s from
+// inside the core back out to sr32_run() or sr32_run_for().
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libsr32.h>
+
+struct Machine {
+	CpuState cs;
+
+	uint8_t *ram;
+	uint64_t ram_size;
+	DecodedIns *dcode;
+	uint8_t *codepage;
+	int fds[SYS_FD_MAX];
+	void *sched;
+	void *timer;
+
+	Sr32IoFn io_fn;
+	void *io_ctx;
+
+	jmp_buf stopped;
+	int status;		// SR32_* once stopped, else -1
+	uint32_t code;
+};
+
+static pthread_once_t machine_once = PTHREAD_ONCE_INIT;
+static __thread Machine *machine_cur;
+
+// s is m->cs, which the core runs on
+static void machine_stop(CpuState *s, uint32_t why, uint32_t val) {
+	Machine *m = machine_cur;
+	m->status = why;
+	m->code = val;
+	longjmp(m->stopped, 1);
+}
+
+static int machine_io(void *ctx, CpuState *s, int write, uint32_t addr, uint32_t *val) {
+	Machine *m = ctx;
+	if (m->io_fn == NULL) return 0;
+	return m->io_fn(m->io_ctx, m, write, addr, val);
+}
+
+static void machine_init(void) {
+	emu_init();
+	emu_stop_hook = machine_stop;
+	emu_io_hook = machine_io;
+}
+
+// install m's state in this thread's view of the emulator
+static void machine_select(Machine *m) {
+	machine_cur = m;
+	emu_ram = m->ram;
+	emu_ram_size = m->ram_size;
+	emu_mask8 = m->ram_size - 1;
+	emu_mask16 = emu_mask8 & (~1);
+	emu_mask32 = emu_mask8 & (~3);
+	emu_dcode = m->dcode;
+	emu_codepage = m->codepage;
+	emu_io_ctx = m;
+	sys_fds_select(m->fds);
+	sched_select(m->sched);
+	timer_select(m->timer);
+}
+
+static void machine_close_fds(Machine *m) {
+	for (unsigned n = 0; n < SYS_FD_MAX; n++) {
+		if (m->fds[n] > 2) {
+			close(m->fds[n]);
+		}
+	}
+	sys_fds_init(m->fds);
+}
+
+// release what sr32_create() allocated (any of it may be missing)
+static void machine_free(Machine *m) {
+	if (m->ram) munmap(m->ram, m->ram_size);
+	if (m->dcode) munmap(m->dcode, sizeof(DecodedIns) * (m->ram_size / 4));
+	if (m->codepage) munmap(m->codepage, m->ram_size / PAGESIZE);
+	free(m->sched);
+	free(m->timer);
+	free(m);
+}
+
+Machine *sr32_create(uint64_t ramsize) {
+	if (ramsize == 0) {
+		ramsize = RAMSIZE_DEFAULT;
+	}
+	if ((ramsize < (64*1024)) || (ramsize > (4ULL*1024*1024*1024)) ||
+		(ramsize & (ramsize - 1))) {
+		return NULL;
+	}
+	Machine *m = calloc(1, sizeof(Machine));
+	if (m == NULL) {
+		return NULL;
+	}
+	pthread_once(&machine_once, machine_init);
+	m->ram_size = ramsize;
+	m->ram = emu_alloc_try(ramsize);
+	m->dcode = emu_alloc_try(sizeof(DecodedIns) * (ramsize / 4));
+	m->codepage = emu_alloc_try(ramsize / PAGESIZE);
+	m->sched = sched_new(1);
+	m->timer = timer_new(1);
+	if ((m->ram == NULL) || (m->dcode == NULL) || (m->codepage == NULL) ||
+		(m->sched == NULL) || (m->timer == NULL)) {
+		machine_free(m);
+		return NULL;
+	}
+	sys_fds_init(m->fds);
+	m->status = -1;
+	return m;
+}
+
+int sr32_load(Machine *m, const char *image, int argc, char **argv) {
+	uint32_t entry;
+	machine_select(m);
+	// start from empty RAM (zeroing bss) with nothing predecoded,
+	// and without the last guest's files
+	emu_clear(m->ram, m->ram_size);
+	emu_clear(m->dcode, sizeof(DecodedIns) * (m->ram_size / 4));
+	emu_clear(m->codepage, m->ram_size / PAGESIZE);
+	machine_close_fds(m);
+	int r = load_image(image, &entry);
+	if (r == 0) {
+		// return address for the entry point: stx r0 to the exit port
+		mem_wr32(entry - 16, 0xfffd002b);
+		memset(&m->cs, 0, sizeof(m->cs));
+		timer_reset(&m->cs);
+		sched_reset(&m->cs);
+		emu_setup(&m->cs, entry, argc, argv);
+		m->status = -1;
+	}
+	return r;
+}
+
+void sr32_set_io(Machine *m, Sr32IoFn fn, void *ctx) {
+	m->io_fn = fn;
+	m->io_ctx = ctx;
+}
+
+int sr32_run(Machine *m) {
+	if (m->status < 0) {
+		machine_select(m);
+		if (setjmp(m->stopped) == 0) {
+			sr32core_predecode(&m->cs);
+		}
+	}
+	return m->status;
+}
+
+int sr32_run_for(Machine *m, uint64_t insns) {
+	CpuState *s = &m->cs;
+	int r = SR32_LIMIT;
+	if (m->status < 0) {
+		machine_select(m);
+		if (setjmp(m->stopped) == 0) {
+			uint64_t end = sched_now(s) + insns;
+			while (sched_now(s) < end) {
+				uint64_t left = end - sched_now(s);
+				if (sr32slice_predecode(s, (left > 0xFFFFFFFF) ? 0xFFFFFFFF : left)) {
+					r = SR32_SYSCALL;
+					break;
+				}
+			}
+			con_flush();
+		}
+	}
+	if (m->status >= 0) {
+		r = m->status;
+	}
+	return r;
+}
+
+uint32_t sr32_exit_code(Machine *m) {
+	return m->code;
+}
+
+CpuState *sr32_cpu(Machine *m) {
+	return &m->cs;
+}
+
+void sr32_destroy(Machine *m) {
+	if (m == NULL) {
+		return;
+	}
+	if (machine_cur == m) {
+		machine_cur = NULL;
+		sched_select(NULL);
+		timer_select(NULL);
+	}
+	machine_close_fds(m);
+	machine_free(m);
+}
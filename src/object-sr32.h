@@ -0,0 +1,64 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#pragma once
+#include <stdint.h>
+
+// SR32 relocatable object (bin/asm <file.s> <file.o>, see bin/ld)
+//
+// An ObjectHeader is followed by the contents of each SECTION_*
+// but bss (hdr.size[n] bytes of each, assembled as if loaded at
+// address 0), then hdr.symcount ObjectSymbols, hdr.fixcount
+// ObjectFixups, and the NUL terminated names the symbols refer to.
+// All fields are little-endian.
+//
+// Each fixup patches the word(s) at offset in its section to refer
+// to a symbol, in the manner of its TYPE_*.  The field being patched
+// is zero.  The linker gathers each section from every object in
+// turn, relocating each symbol not marked SYM_ABS by the address its
+// section of its object was placed at.  Undefined symbols are
+// resolved against the SYM_GLOBAL symbols of all the objects linked.
+
+#define OBJECT_MAGIC   0x4f335253 // "SR3O"
+#define OBJECT_VERSION 2
+
+// sections, in the order they are laid out
+#define SECTION_TEXT   0
+#define SECTION_RODATA 1
+#define SECTION_DATA   2
+#define SECTION_BSS    3	// zeroed, takes no file space
+#define SECTION_COUNT  4
+
+// fixup types
+#define TYPE_PCREL_S16	1	// branch offset
+#define TYPE_PCREL_S21	2	// jal offset
+#define TYPE_ABS_U32	3	// whole word
+#define TYPE_ABS_HILO   4	// lui/addi pair
+#define TYPE_PCREL_HILO 5	// auipc/addi pair
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size[SECTION_COUNT];	// bytes in each (multiples of 4)
+	uint32_t symcount;
+	uint32_t fixcount;
+	uint32_t strsize;	// bytes of names following the fixups
+} ObjectHeader;
+
+#define SYM_DEFINED 1
+#define SYM_GLOBAL  2	// visible to other objects (.global)
+#define SYM_ABS     4	// value is not an offset in this object (.equ)
+
+typedef struct {
+	uint32_t value;
+	uint32_t name;		// offset of name from end of fixups
+	uint32_t flags;
+	uint32_t section;	// SECTION_* the value is an offset in
+} ObjectSymbol;
+
+typedef struct {
+	uint32_t section;
+	uint32_t offset;
+	uint32_t type;
+	uint32_t sym;		// index in this object's symbols
+} ObjectFixup;
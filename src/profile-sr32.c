@@ -0,0 +1,283 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Exact per-pc execution profiler (-p, ref engine)
+//
+// The core increments prof_count[pc >> 2] for every instruction it
+// fetches and calls prof_call() for every jal or jalr that writes
+// the link register (r1).  At exit prof_report() attributes the
+// counts to functions (the entry point plus every call target seen)
+// and prints a flat profile, the call edges between functions, and
+// the hottest individual instructions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <emulator-sr32.h>
+
+#define PROF_HOT 32
+
+typedef struct {
+	uint32_t from;		// address of the call instruction
+	uint32_t to;
+	uint64_t count;
+} ProfEdge;
+
+typedef struct {
+	uint32_t addr;
+	uint64_t insns;
+	uint64_t calls;
+} ProfFunc;
+
+uint64_t *prof_count;
+
+static ProfEdge *prof_edges;
+static uint32_t prof_edge_max;
+static uint32_t prof_nedges;
+static uint32_t prof_entry;
+
+static ProfFunc *prof_funcs;
+static uint32_t prof_nfuncs;
+
+static inline uint32_t prof_hash(uint32_t from, uint32_t to) {
+	return ((from >> 2) * 0x9E3779B1U) ^ (to >> 2);
+}
+
+static void prof_grow(void) {
+	ProfEdge *old = prof_edges;
+	uint32_t max = prof_edge_max;
+	prof_edge_max = max ? (max * 2) : 4096;
+	prof_edges = calloc(prof_edge_max, sizeof(ProfEdge));
+	if (prof_edges == NULL) {
+		fprintf(stderr, "emu: out of memory\n");
+		exit(1);
+	}
+	prof_nedges = 0;
+	for (uint32_t n = 0; n < max; n++) {
+		if (old[n].count == 0) continue;
+		uint32_t mask = prof_edge_max - 1;
+		uint32_t h = prof_hash(old[n].from, old[n].to) & mask;
+		while (prof_edges[h].count) h = (h + 1) & mask;
+		prof_edges[h] = old[n];
+		prof_nedges++;
+	}
+	free(old);
+}
+
+void prof_call(uint32_t from, uint32_t to) {
+	from &= emu_mask32;
+	to &= emu_mask32;
+	uint32_t mask = prof_edge_max - 1;
+	uint32_t h = prof_hash(from, to) & mask;
+	for (;;) {
+		ProfEdge *e = prof_edges + h;
+		if (e->count == 0) break;
+		if ((e->from == from) && (e->to == to)) {
+			e->count++;
+			return;
+		}
+		h = (h + 1) & mask;
+	}
+	if ((prof_nedges * 2) >= prof_edge_max) {
+		prof_grow();
+		prof_call(from, to);
+		return;
+	}
+	prof_edges[h].from = from;
+	prof_edges[h].to = to;
+	prof_edges[h].count = 1;
+	prof_nedges++;
+}
+
+static int cmp_u32(const void *_a, const void *_b) {
+	uint32_t a = *((const uint32_t*) _a);
+	uint32_t b = *((const uint32_t*) _b);
+	return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+// function containing addr, or NULL if it precedes them all
+static ProfFunc *prof_func(uint32_t addr) {
+	uint32_t lo = 0, hi = prof_nfuncs;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (prof_funcs[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo ? (prof_funcs + lo - 1) : NULL;
+}
+
+static const char *prof_name(ProfFunc *f, char *buf) {
+	if (f == NULL) return "?";
+	const char *name = emu_symbol(f->addr);
+	if (name) return name;
+	sprintf(buf, "%08x", f->addr);
+	return buf;
+}
+
+static int cmp_func(const void *_a, const void *_b) {
+	const ProfFunc *a = *((ProfFunc* const*) _a);
+	const ProfFunc *b = *((ProfFunc* const*) _b);
+	return (a->insns > b->insns) ? -1 : ((a->insns < b->insns) ? 1 : 0);
+}
+
+static int cmp_edge(const void *_a, const void *_b) {
+	const ProfEdge *a = _a;
+	const ProfEdge *b = _b;
+	return (a->count > b->count) ? -1 : ((a->count < b->count) ? 1 : 0);
+}
+
+static int cmp_pair(const void *_a, const void *_b) {
+	const ProfEdge *a = _a;
+	const ProfEdge *b = _b;
+	if (a->from != b->from) return (a->from < b->from) ? -1 : 1;
+	return (a->to < b->to) ? -1 : ((a->to > b->to) ? 1 : 0);
+}
+
+static void prof_report(void) {
+	char n0[16], n1[16], dis[128];
+
+	// functions: the entry point and every call target
+	uint32_t *addrs = malloc(sizeof(uint32_t) * (prof_nedges + 1));
+	uint32_t count = 0;
+	addrs[count++] = prof_entry & emu_mask32;
+	for (uint32_t n = 0; n < prof_edge_max; n++) {
+		if (prof_edges[n].count) addrs[count++] = prof_edges[n].to;
+	}
+	qsort(addrs, count, sizeof(uint32_t), cmp_u32);
+	prof_funcs = calloc(count, sizeof(ProfFunc));
+	for (uint32_t n = 0; n < count; n++) {
+		if ((n == 0) || (addrs[n] != addrs[n - 1])) {
+			prof_funcs[prof_nfuncs++].addr = addrs[n];
+		}
+	}
+	free(addrs);
+
+	// only counter pages that were ever touched need scanning
+	uint64_t words = emu_ram_size / 4;
+	uint64_t pages = (words * sizeof(uint64_t)) / PAGESIZE;
+	uint32_t per_page = PAGESIZE / sizeof(uint64_t);
+	unsigned char *resident = malloc(pages);
+	if ((resident == NULL) || mincore(prof_count, pages * PAGESIZE, resident)) {
+		fprintf(stderr, "emu: cannot scan profile counters\n");
+		return;
+	}
+	uint32_t hot[PROF_HOT];
+	uint32_t nhot = 0;
+	uint64_t total = 0;
+	ProfFunc unknown = { 0 };
+	for (uint64_t p = 0; p < pages; p++) {
+		if (!(resident[p] & 1)) continue;
+		for (uint64_t w = p * per_page; w < (p + 1) * per_page; w++) {
+			uint64_t c = prof_count[w];
+			if (c == 0) continue;
+			total += c;
+			ProfFunc *f = prof_func(w * 4);
+			if (f == NULL) f = &unknown;
+			f->insns += c;
+			// keep the hottest words, sorted by count
+			uint32_t i = nhot;
+			if (nhot < PROF_HOT) {
+				nhot++;
+			} else if (c <= prof_count[hot[PROF_HOT - 1]]) {
+				continue;
+			} else {
+				i = PROF_HOT - 1;
+			}
+			while ((i > 0) && (prof_count[hot[i - 1]] < c)) {
+				hot[i] = hot[i - 1];
+				i--;
+			}
+			hot[i] = w;
+		}
+	}
+	free(resident);
+	if (total == 0) total = 1;
+
+	// merge call sites into caller function -> callee edges:
+	// sort them by caller and callee and combine neighbours
+	ProfEdge *edges = malloc(sizeof(ProfEdge) * (prof_nedges + 1));
+	uint32_t nedges = 0;
+	for (uint32_t n = 0; n < prof_edge_max; n++) {
+		ProfEdge *e = prof_edges + n;
+		if (e->count == 0) continue;
+		prof_func(e->to)->calls += e->count;
+		ProfFunc *from = prof_func(e->from);
+		edges[nedges].from = from ? from->addr : 0xFFFFFFFF;
+		edges[nedges].to = e->to;
+		edges[nedges++].count = e->count;
+	}
+	qsort(edges, nedges, sizeof(ProfEdge), cmp_pair);
+	uint32_t merged = 0;
+	for (uint32_t n = 0; n < nedges; n++) {
+		if (merged && (edges[merged - 1].from == edges[n].from) &&
+			(edges[merged - 1].to == edges[n].to)) {
+			edges[merged - 1].count += edges[n].count;
+		} else {
+			edges[merged++] = edges[n];
+		}
+	}
+	nedges = merged;
+	qsort(edges, nedges, sizeof(ProfEdge), cmp_edge);
+
+	ProfFunc **list = malloc(sizeof(ProfFunc*) * (prof_nfuncs + 1));
+	for (uint32_t n = 0; n < prof_nfuncs; n++) {
+		list[n] = prof_funcs + n;
+	}
+	qsort(list, prof_nfuncs, sizeof(ProfFunc*), cmp_func);
+
+	fprintf(stderr, "profile: %llu instructions, %u functions\n",
+		(unsigned long long) total, prof_nfuncs);
+	fprintf(stderr, "       insns      %%        calls  function\n");
+	for (uint32_t n = 0; n < prof_nfuncs; n++) {
+		ProfFunc *f = list[n];
+		if (f->insns == 0) break;
+		fprintf(stderr, "%12llu %6.2f %12llu  %s\n",
+			(unsigned long long) f->insns, (100.0 * f->insns) / total,
+			(unsigned long long) f->calls, prof_name(f, n0));
+	}
+	if (unknown.insns) {
+		fprintf(stderr, "%12llu %6.2f %12s  ?\n",
+			(unsigned long long) unknown.insns,
+			(100.0 * unknown.insns) / total, "");
+	}
+
+	fprintf(stderr, "\ncalls: %u edges\n", nedges);
+	fprintf(stderr, "       calls  caller -> callee\n");
+	for (uint32_t n = 0; n < nedges; n++) {
+		ProfEdge *e = edges + n;
+		ProfFunc *from = (e->from == 0xFFFFFFFF) ? NULL : prof_func(e->from);
+		fprintf(stderr, "%12llu  %s -> %s\n", (unsigned long long) e->count,
+			prof_name(from, n0), prof_name(prof_func(e->to), n1));
+	}
+
+	fprintf(stderr, "\nhot instructions:\n");
+	fprintf(stderr, "      pc        count      %%  function\n");
+	for (uint32_t n = 0; n < nhot; n++) {
+		uint32_t pc = hot[n] * 4;
+		uint64_t c = prof_count[hot[n]];
+		ProfFunc *f = prof_func(pc);
+		sr32dis(pc, mem_rd32(pc), dis);
+		if (f) {
+			snprintf(n1, sizeof(n1), "+0x%x", pc - f->addr);
+		} else {
+			n1[0] = 0;
+		}
+		fprintf(stderr, "%08x %12llu %6.2f  %s%s  %s\n", pc,
+			(unsigned long long) c, (100.0 * c) / total,
+			prof_name(f, n0), n1, dis);
+	}
+	free(edges);
+	free(list);
+}
+
+void prof_init(uint32_t entry) {
+	prof_count = emu_alloc((emu_ram_size / 4) * sizeof(uint64_t));
+	prof_entry = entry;
+	prof_grow();
+	atexit(prof_report);
+}
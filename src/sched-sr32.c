@@ -0,0 +1,142 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Instruction count event scheduler
+//
+// Each hart has a min-heap of pending events ordered by the
+// instruction count they are due at.  s->countdown holds the
+// instructions left until the earliest of them (or SCHED_IDLE if
+// there are none), so cores need only test it at block boundaries
+// and call sched_run() when it runs out.
+//
+// The retired instruction count is s->icount plus however much of
+// s->period the core has counted down since the scheduler last set
+// s->countdown.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <emulator-sr32.h>
+
+#define SCHED_MAX  64
+#define SCHED_IDLE 0x40000000
+
+typedef struct {
+	uint64_t when;
+	SchedFn fn;
+	void *ctx;
+} SchedEvent;
+
+typedef struct {
+	SchedEvent ev[SCHED_MAX];
+	uint32_t count;
+} Sched;
+
+static Sched sched_main[HART_MAX];
+static EMU_GUEST Sched *sched_hart = sched_main;
+
+uint64_t sched_now(CpuState *s) {
+	return s->icount + (((int64_t) s->period) - s->countdown);
+}
+
+// restart the countdown toward the earliest event
+static void sched_rearm(CpuState *s, Sched *q) {
+	uint64_t now = sched_now(s);
+	uint64_t delta = SCHED_IDLE;
+	if (q->count) {
+		uint64_t when = q->ev[0].when;
+		delta = (when <= now) ? 0 : (when - now);
+		if (delta > SCHED_IDLE) delta = SCHED_IDLE;
+	}
+	s->icount = now;
+	s->period = delta;
+	s->countdown = delta;
+}
+
+static void sched_up(Sched *q, uint32_t n) {
+	SchedEvent e = q->ev[n];
+	while (n > 0) {
+		uint32_t parent = (n - 1) / 2;
+		if (q->ev[parent].when <= e.when) break;
+		q->ev[n] = q->ev[parent];
+		n = parent;
+	}
+	q->ev[n] = e;
+}
+
+static void sched_down(Sched *q, uint32_t n) {
+	SchedEvent e = q->ev[n];
+	for (;;) {
+		uint32_t child = n * 2 + 1;
+		if (child >= q->count) break;
+		if (((child + 1) < q->count) &&
+			(q->ev[child + 1].when < q->ev[child].when)) {
+			child++;
+		}
+		if (e.when <= q->ev[child].when) break;
+		q->ev[n] = q->ev[child];
+		n = child;
+	}
+	q->ev[n] = e;
+}
+
+static void sched_remove(Sched *q, uint32_t n) {
+	q->count--;
+	if (n == q->count) return;
+	q->ev[n] = q->ev[q->count];
+	sched_up(q, n);
+	sched_down(q, n);
+}
+
+void sched_at(CpuState *s, uint64_t when, SchedFn fn, void *ctx) {
+	Sched *q = sched_hart + s->hart;
+	if (q->count == SCHED_MAX) {
+		fprintf(stderr, "emu: too many scheduled events\n");
+		exit(1);
+	}
+	q->ev[q->count].when = when;
+	q->ev[q->count].fn = fn;
+	q->ev[q->count].ctx = ctx;
+	sched_up(q, q->count++);
+	sched_rearm(s, q);
+}
+
+void sched_cancel(CpuState *s, SchedFn fn, void *ctx) {
+	Sched *q = sched_hart + s->hart;
+	for (uint32_t n = 0; n < q->count; n++) {
+		if ((q->ev[n].fn == fn) && (q->ev[n].ctx == ctx)) {
+			sched_remove(q, n);
+			sched_rearm(s, q);
+			return;
+		}
+	}
+}
+
+void sched_run(CpuState *s) {
+	Sched *q = sched_hart + s->hart;
+	uint64_t now = sched_now(s);
+	while (q->count && (q->ev[0].when <= now)) {
+		SchedEvent e = q->ev[0];
+		sched_remove(q, 0);
+		e.fn(s, e.ctx);
+	}
+	sched_rearm(s, q);
+}
+
+// drop every pending event and restart the count from zero
+void sched_reset(CpuState *s) {
+	sched_hart[s->hart].count = 0;
+	s->icount = 0;
+	s->period = 0;
+	s->countdown = 0;
+}
+
+// queues for harts 0 .. harts - 1, in place of the emulator's own
+void *sched_new(uint32_t harts) {
+	void *q = calloc(harts, sizeof(Sched));
+	return q;
+}
+
+void sched_select(void *q) {
+	sched_hart = q ? q : sched_main;
+}
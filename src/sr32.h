@@ -16,6 +16,9 @@
 #define IR_SLTU 9
 #define IR_MUL 10
 #define IR_DIV 11
+#define IR_AMOSWAP 12
+#define IR_AMOADD 13
+#define IR_AMOCAS 14
 #define IR_JALR 15
 
 #define B_BEQ 0
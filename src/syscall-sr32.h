@@ -0,0 +1,43 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#pragma once
+
+// SR32 emulator syscall ABI
+//
+// The syscall number is the i21 field of the syscall instruction.
+// Arguments are passed in a0-a7 (r10-r17) and the result is returned
+// in a0, with failures returned as negated host errno values.  Guest
+// buffers are passed to the host directly, without copying.
+//
+// SYS_OPEN   a0=path a1=flags a2=mode   -> fd
+// SYS_READ   a0=fd a1=buf a2=len        -> bytes read
+// SYS_WRITE  a0=fd a1=buf a2=len        -> bytes written
+// SYS_CLOSE  a0=fd                      -> 0
+// SYS_LSEEK  a0=fd a1=offset a2=whence  -> new offset
+// SYS_MMAP   a0=addr a1=len a2=fd a3=offset -> addr
+//
+// Guest fds 0-2 are the host's stdin, stdout, and stderr.  SYS_MMAP
+// maps a file privately (copy-on-write) over guest RAM.  addr and
+// offset must be page aligned and the range may not hold code that
+// has already been executed.
+
+#define SYS_OPEN   1
+#define SYS_READ   2
+#define SYS_WRITE  3
+#define SYS_CLOSE  4
+#define SYS_LSEEK  5
+#define SYS_MMAP   6
+
+// SYS_OPEN flags
+#define SYS_O_RDONLY 0x000
+#define SYS_O_WRONLY 0x001
+#define SYS_O_RDWR   0x002
+#define SYS_O_CREAT  0x040
+#define SYS_O_TRUNC  0x200
+#define SYS_O_APPEND 0x400
+
+// SYS_LSEEK whence
+#define SYS_SEEK_SET 0
+#define SYS_SEEK_CUR 1
+#define SYS_SEEK_END 2
@@ -0,0 +1,88 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Programmable timer, one per hart, counting retired instructions
+//
+// ldx -12  instructions retired by this hart (low 32 bits)
+// ldx -13  high 32 bits of the count as of the last ldx -12
+// ldx -14  expirations since the last ldx -14
+// stx -14  expire every n instructions from now (0 stops the timer)
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <emulator-sr32.h>
+
+typedef struct {
+	uint64_t next;		// instruction count of the next expiration
+	uint32_t period;
+	uint32_t fired;
+	uint32_t hi;
+} Timer;
+
+static Timer timer_main[HART_MAX];
+static EMU_GUEST Timer *timer_hart = timer_main;
+
+static void timer_fire(CpuState *s, void *ctx) {
+	Timer *t = ctx;
+	t->fired++;
+	t->next += t->period;
+	sched_at(s, t->next, timer_fire, t);
+}
+
+static uint32_t timer_rd(IoDevice *dev, CpuState *s, uint32_t addr) {
+	Timer *t = timer_hart + s->hart;
+	uint64_t now;
+	uint32_t n;
+	switch (addr) {
+	case -12:
+		now = sched_now(s);
+		t->hi = now >> 32;
+		return now;
+	case -13:
+		return t->hi;
+	case -14:
+		n = t->fired;
+		t->fired = 0;
+		return n;
+	}
+	return 0;
+}
+
+static void timer_wr(IoDevice *dev, CpuState *s, uint32_t addr, uint32_t val) {
+	Timer *t = timer_hart + s->hart;
+	if (addr != -14) return;
+	sched_cancel(s, timer_fire, t);
+	t->period = val;
+	t->fired = 0;
+	if (val) {
+		t->next = sched_now(s) + val;
+		sched_at(s, t->next, timer_fire, t);
+	}
+}
+
+static IoDevice timer_dev = {
+	.name = "timer", .base = -14, .size = 3, .rd32 = timer_rd, .wr32 = timer_wr,
+};
+
+void timer_init(void) {
+	io_register(&timer_dev);
+}
+
+void timer_reset(CpuState *s) {
+	Timer *t = timer_hart + s->hart;
+	sched_cancel(s, timer_fire, t);
+	t->next = 0;
+	t->period = 0;
+	t->fired = 0;
+	t->hi = 0;
+}
+
+void *timer_new(uint32_t harts) {
+	void *t = calloc(harts, sizeof(Timer));
+	return t;
+}
+
+void timer_select(void *t) {
+	timer_hart = t ? t : timer_main;
+}
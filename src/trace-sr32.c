@@ -0,0 +1,89 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Decode an emu -tx binary trace into the -tf/-tr text format
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sr32.h"
+#include "trace-sr32.h"
+
+void sr32dis(uint32_t pc, uint32_t ins, char *out);
+
+static FILE *fp;
+
+static uint32_t rd8(void) {
+	int c = getc(fp);
+	if (c == EOF) {
+		fprintf(stderr, "trace: truncated record\n");
+		exit(1);
+	}
+	return c;
+}
+
+static uint32_t rd32(void) {
+	uint32_t n = rd8();
+	n |= rd8() << 8;
+	n |= rd8() << 16;
+	n |= rd8() << 24;
+	return n;
+}
+
+int main(int argc, char **argv) {
+	TraceHeader hdr;
+	char dis[128];
+	int disasm = 0;
+
+	if ((argc > 1) && !strcmp(argv[1], "-d")) {
+		disasm = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 2) {
+		fprintf(stderr, "usage: trace [ -d ] <tracefile>\n");
+		return -1;
+	}
+	if ((fp = fopen(argv[1], "r")) == NULL) {
+		fprintf(stderr, "trace: cannot open: %s\n", argv[1]);
+		return -1;
+	}
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+		(hdr.magic != TRACE_MAGIC) || (hdr.version != TRACE_VERSION)) {
+		fprintf(stderr, "trace: not a trace file: %s\n", argv[1]);
+		return -1;
+	}
+
+	uint32_t pc = hdr.pc;
+	int tag;
+	while ((tag = getc(fp)) != EOF) {
+		if ((tag == TR_FETCH) || (tag == TR_JUMP)) {
+			if (tag == TR_JUMP) {
+				uint32_t z = 0;
+				uint32_t shift = 0;
+				uint32_t x;
+				do {
+					x = rd8();
+					z |= (x & 0x7F) << shift;
+					shift += 7;
+				} while (x & 0x80);
+				pc += (z >> 1) ^ -(z & 1);
+			}
+			uint32_t ins = rd32();
+			if (disasm) {
+				sr32dis(pc, ins, dis);
+				printf("%08x %08x  %s\n", pc, ins, dis);
+			} else {
+				printf("%08x %08x\n", pc, ins);
+			}
+			pc += 4;
+		} else if ((tag & 0xE0) == TR_REG) {
+			printf("%08x -> X%d\n", rd32(), tag & 31);
+		} else {
+			fprintf(stderr, "trace: bad record tag %02x\n", tag);
+			return -1;
+		}
+	}
+	return 0;
+}
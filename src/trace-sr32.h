@@ -0,0 +1,34 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#pragma once
+#include <stdint.h>
+
+// SR32 binary trace
+//
+// A TraceHeader followed by a stream of records, each starting with
+// a tag byte:
+//
+//   TR_FETCH        ins:u32     fetch at the pc following the last
+//   TR_JUMP  delta  ins:u32     fetch at last pc + 4 + delta
+//   TR_REG+n        val:u32     write of val to register n
+//
+// delta is a zigzag encoded varint (7 bits per byte, low first, high
+// bit set on all but the last).  The pc "following" the start of the
+// trace is hdr.pc.  All fields are little-endian.
+
+#define TRACE_MAGIC   0x54335253 // "SR3T"
+#define TRACE_VERSION 1
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pc;
+	uint32_t reserved;
+} TraceHeader;
+
+#define TR_FETCH 0x01
+#define TR_JUMP  0x02
+#define TR_REG   0x20 // 0x20..0x3F
+
+#define TR_MAXREC 10
@@ -0,0 +1,120 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Binary trace ring buffer (-tx)
+//
+// The core appends records to the current chunk of a ring of
+// TRACE_CHUNKS buffers via trace_fetch() and trace_reg().  When a
+// chunk fills, trace_next() hands it to a writer thread and moves
+// on to the next, waiting only if the writer has fallen a full ring
+// behind.  Nothing is dropped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <emulator-sr32.h>
+#include <trace-sr32.h>
+
+#define TRACE_CHUNKS     8
+#define TRACE_CHUNK_SIZE (1024*1024)
+
+typedef struct {
+	uint8_t *data;
+	uint32_t len;
+	uint32_t full;
+} TraceChunk;
+
+uint8_t *trace_ptr;
+uint8_t *trace_end;
+uint32_t trace_pc;
+
+static TraceChunk trace_chunk[TRACE_CHUNKS];
+static uint32_t trace_cur;
+static uint32_t trace_done;
+static int trace_fd;
+static pthread_t trace_thread;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_cond = PTHREAD_COND_INITIALIZER;
+
+static void *trace_writer(void *arg) {
+	uint32_t n = 0;
+	for (;;) {
+		TraceChunk *c = trace_chunk + n;
+		pthread_mutex_lock(&trace_lock);
+		while (!c->full && !trace_done) {
+			pthread_cond_wait(&trace_cond, &trace_lock);
+		}
+		pthread_mutex_unlock(&trace_lock);
+		if (!c->full) {
+			break;
+		}
+		if (write(trace_fd, c->data, c->len) != c->len) {
+			fprintf(stderr, "emu: error writing trace\n");
+			exit(1);
+		}
+		pthread_mutex_lock(&trace_lock);
+		c->full = 0;
+		pthread_cond_broadcast(&trace_cond);
+		pthread_mutex_unlock(&trace_lock);
+		n = (n + 1) % TRACE_CHUNKS;
+	}
+	return NULL;
+}
+
+void trace_next(void) {
+	TraceChunk *c = trace_chunk + trace_cur;
+	pthread_mutex_lock(&trace_lock);
+	c->len = trace_ptr - c->data;
+	c->full = 1;
+	pthread_cond_broadcast(&trace_cond);
+	trace_cur = (trace_cur + 1) % TRACE_CHUNKS;
+	c = trace_chunk + trace_cur;
+	while (c->full) {
+		pthread_cond_wait(&trace_cond, &trace_lock);
+	}
+	pthread_mutex_unlock(&trace_lock);
+	trace_ptr = c->data;
+	trace_end = c->data + TRACE_CHUNK_SIZE;
+}
+
+static void trace_close(void) {
+	trace_next();
+	pthread_mutex_lock(&trace_lock);
+	trace_done = 1;
+	pthread_cond_broadcast(&trace_cond);
+	pthread_mutex_unlock(&trace_lock);
+	pthread_join(trace_thread, NULL);
+	close(trace_fd);
+}
+
+void trace_open(const char *fn, uint32_t pc) {
+	TraceHeader hdr;
+	trace_fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (trace_fd < 0) {
+		fprintf(stderr, "emu: cannot write to: %s\n", fn);
+		exit(1);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = TRACE_MAGIC;
+	hdr.version = TRACE_VERSION;
+	hdr.pc = pc;
+	if (write(trace_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		fprintf(stderr, "emu: error writing trace\n");
+		exit(1);
+	}
+	for (uint32_t n = 0; n < TRACE_CHUNKS; n++) {
+		trace_chunk[n].data = emu_alloc(TRACE_CHUNK_SIZE);
+	}
+	trace_ptr = trace_chunk[0].data;
+	trace_end = trace_ptr + TRACE_CHUNK_SIZE;
+	trace_pc = pc;
+	if (pthread_create(&trace_thread, NULL, trace_writer, NULL)) {
+		fprintf(stderr, "emu: cannot create trace thread\n");
+		exit(1);
+	}
+	atexit(trace_close);
+}
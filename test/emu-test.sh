@@ -0,0 +1,50 @@
+#!/bin/sh
+# Copyright 2025, Brian Swetland <swetland@frotz.net>
+# Licensed under the Apache License, Version 2.0.
+
+# usage: emu-test.sh <emu> <gen dir>
+#
+# Command line checks of bin/emu, printing PASS or FAIL for each.
+# Exits nonzero if any fail.
+
+emu=$1
+gen=$2
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+status=0
+check() {
+	if [ "$1" = 0 ]; then
+		echo "PASS: $2" >&2
+	else
+		echo "FAIL: $2" >&2
+		status=1
+	fi
+}
+
+"$emu" -snap "$tmp/s.snap" "$gen/test/snap.img"
+check $? "snapshot a run"
+
+# 2002 instructions up to the snapshot and 10004 after it
+"$emu" -si -restore "$tmp/s.snap" 2>"$tmp/out" &&
+	grep -q '^stats: insns=10004 ' "$tmp/out"
+check $? "count only restored instructions"
+
+"$emu" -p -restore "$tmp/s.snap" 2>"$tmp/out" &&
+	grep -q '^profile:' "$tmp/out"
+check $? "profile a restored run"
+
+# RAM sizes that are not a power of two from 64K to 4G
+bad_size() {
+	cp "$tmp/s.snap" "$tmp/bad.snap"
+	printf "$2" | dd of="$tmp/bad.snap" bs=1 seek=8 conv=notrunc 2>/dev/null
+	"$emu" -restore "$tmp/bad.snap" 2>"$tmp/out"
+	[ $? = 1 ] && grep -q '^emu: corrupt snapshot' "$tmp/out"
+	check $? "reject a snapshot of $1 RAM"
+}
+bad_size 0 '\0\0\0\0\0\0\0\0'
+bad_size 32K '\0\200\0\0\0\0\0\0'
+bad_size 24M '\0\0\200\1\0\0\0\0'
+bad_size 8G '\0\0\0\0\2\0\0\0'
+
+exit $status
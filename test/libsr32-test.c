@@ -0,0 +1,225 @@
+// Copyright 2025, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// Host side checks of libsr32.a (make test)
+//
+// usage: libsr32-test <gen dir>  (images from make bench and test)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <libsr32.h>
+
+static const char *names[] = { "bench/fib", "bench/crc32", "bench/memcpy" };
+static uint64_t fresh[3];	// instructions each retires on a new Machine
+
+static const char *dir;
+static int failed;
+
+static void check(int ok, const char *what) {
+	fprintf(stderr, "%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if (!ok) failed++;
+}
+
+static char *image(const char *name) {
+	static char fn[4096];
+	snprintf(fn, sizeof(fn), "%s/%s.img", dir, name);
+	return fn;
+}
+
+// run name to completion on m, returning instructions retired
+static uint64_t run(Machine *m, const char *name) {
+	if (sr32_load(m, image(name), 0, NULL)) {
+		exit(1);
+	}
+	if ((sr32_run(m) != SR32_EXIT) || (sr32_exit_code(m) != 0)) {
+		fprintf(stderr, "%s did not exit cleanly\n", name);
+		return 0;
+	}
+	return sched_now(sr32_cpu(m));
+}
+
+// Loading an image into a Machine that has run another must not
+// leave any of the old one (code, predecode, bss) behind.
+static void test_reload(void) {
+	Machine *m = sr32_create(0);
+	int ok = 1;
+	for (unsigned n = 0; n < 3; n++) {
+		uint64_t count = run(m, names[n]);
+		if ((count == 0) || (count != fresh[n])) {
+			fprintf(stderr, "%s retired %llu, not %llu, after reload\n", names[n],
+				(unsigned long long) count, (unsigned long long) fresh[n]);
+			ok = 0;
+		}
+	}
+	sr32_destroy(m);
+	check(ok, "reload a used Machine");
+}
+
+static void *run_thread(void *arg) {
+	unsigned n = (uintptr_t) arg;
+	Machine *m = sr32_create(0);
+	uint64_t count = run(m, names[n]);
+	sr32_destroy(m);
+	return (void*) (uintptr_t) (count == fresh[n]);
+}
+
+// Machines on different threads run at once, undisturbed.
+static void test_threads(void) {
+	pthread_t t[6];
+	int ok = 1;
+	for (unsigned n = 0; n < 6; n++) {
+		if (pthread_create(t + n, NULL, run_thread, (void*) (uintptr_t) (n % 3))) {
+			exit(1);
+		}
+	}
+	for (unsigned n = 0; n < 6; n++) {
+		void *r;
+		pthread_join(t[n], &r);
+		if (r == NULL) ok = 0;
+	}
+	check(ok, "run Machines on several threads");
+}
+
+// Slices end exactly after the instructions asked for, or just
+// after a syscall, and a guest stopping its own hart mid slice
+// leaves its state in the Machine's CpuState.
+static void test_slices(void) {
+	int ok = 1;
+	Machine *m = sr32_create(0);
+	uint64_t count = 0;
+	if (sr32_load(m, image(names[0]), 0, NULL)) {
+		exit(1);
+	}
+	for (;;) {
+		int r = sr32_run_for(m, 1000);
+		uint64_t now = sched_now(sr32_cpu(m));
+		if (r != SR32_LIMIT) {
+			if ((r != SR32_EXIT) || (now != fresh[0]) || ((now - count) > 1000)) ok = 0;
+			break;
+		}
+		if ((now - count) != 1000) ok = 0;
+		count = now;
+	}
+
+	CpuState *s = sr32_cpu(m);
+	if (sr32_load(m, image("test/slice"), 0, NULL)) {
+		exit(1);
+	}
+	uint32_t entry = s->pc;
+	if ((sr32_run_for(m, 2) != SR32_LIMIT) || (sched_now(s) != 2) ||
+		(s->pc != (entry + 8)) || (s->r[9] != 1)) ok = 0;
+	if ((sr32_run_for(m, 100) != SR32_SYSCALL) || (sched_now(s) != 3) ||
+		(s->pc != (entry + 12)) || (s->r[10] != -9)) ok = 0;
+	if ((sr32_run_for(m, 1001) != SR32_LIMIT) || (sched_now(s) != 1004) ||
+		(s->r[9] != 2)) ok = 0;
+	if ((sr32_run_for(m, 10000) != SR32_HALT) || (sched_now(s) != 2007) ||
+		(s->pc != (entry + 36)) || (s->r[9] != 3)) ok = 0;
+	if (sr32_run_for(m, 10000) != SR32_HALT) ok = 0;
+	sr32_destroy(m);
+	check(ok, "run in exact slices");
+}
+
+static pthread_mutex_t meet_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t meet_cond = PTHREAD_COND_INITIALIZER;
+static unsigned meet_count;
+
+// ldx -100 waits (up to a few seconds) for both guests to get there
+static int meet_io(void *ctx, Machine *m, int write, uint32_t addr, uint32_t *val) {
+	if (write || (addr != (uint32_t) -100)) return 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 5;
+	pthread_mutex_lock(&meet_lock);
+	meet_count++;
+	pthread_cond_broadcast(&meet_cond);
+	while (meet_count < 2) {
+		if (pthread_cond_timedwait(&meet_cond, &meet_lock, &ts)) break;
+	}
+	*val = meet_count;
+	pthread_mutex_unlock(&meet_lock);
+	return 1;
+}
+
+static void *meet_thread(void *arg) {
+	Machine *m = arg;
+	sr32_run(m);
+	return NULL;
+}
+
+// Two guests each waiting (in their device callback) on the other
+// only both finish if they are running at the same time.
+static void test_meet(void) {
+	Machine *m[2];
+	pthread_t t[2];
+	for (unsigned n = 0; n < 2; n++) {
+		m[n] = sr32_create(0);
+		if (sr32_load(m[n], image("test/meet"), 0, NULL)) {
+			exit(1);
+		}
+		sr32_set_io(m[n], meet_io, NULL);
+		if (pthread_create(t + n, NULL, meet_thread, m[n])) {
+			exit(1);
+		}
+	}
+	int ok = 1;
+	for (unsigned n = 0; n < 2; n++) {
+		pthread_join(t[n], NULL);
+		if ((sr32_exit_code(m[n]) != 0) || (sr32_cpu(m[n])->r[10] != 2)) ok = 0;
+		sr32_destroy(m[n]);
+	}
+	check(ok, "run Machines at the same time");
+}
+
+// bytes of address space this process has mapped
+static uint64_t vm_size(void) {
+	unsigned long long pages = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if (fp != NULL) {
+		if (fscanf(fp, "%llu", &pages) != 1) pages = 0;
+		fclose(fp);
+	}
+	return pages * 4096;
+}
+
+// Out of address space after mapping a 64M Machine's RAM but not its
+// predecode table, sr32_create() returns NULL and unmaps the RAM.
+static void test_nomem(void) {
+	struct rlimit old, lim;
+	if (getrlimit(RLIMIT_AS, &old)) {
+		exit(1);
+	}
+	vm_size();
+	uint64_t before = vm_size();
+	lim = old;
+	lim.rlim_cur = before + (96 << 20);
+	if (setrlimit(RLIMIT_AS, &lim)) {
+		exit(1);
+	}
+	Machine *m = sr32_create(64 << 20);
+	setrlimit(RLIMIT_AS, &old);
+	uint64_t after = vm_size();
+	check((m == NULL) && (after == before), "fail sr32_create() cleanly");
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: libsr32-test <gen dir>\n");
+		return 1;
+	}
+	dir = argv[1];
+	for (unsigned n = 0; n < 3; n++) {
+		Machine *m = sr32_create(0);
+		fresh[n] = run(m, names[n]);
+		sr32_destroy(m);
+	}
+	test_reload();
+	test_slices();
+	test_threads();
+	test_meet();
+	test_nomem();
+	return failed ? 1 : 0;
+}
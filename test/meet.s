@@ -0,0 +1,5 @@
+// reads the libsr32-test device until its host thread lets it go
+
+start:
+	ldx a0, -100
+	ret
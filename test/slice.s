@@ -0,0 +1,16 @@
+// libsr32-test time slices: a syscall, a loop, then the guest
+// stops its own hart
+
+start:
+	li s1, 1
+	li a0, 99
+	syscall 5	// lseek on a bad fd
+	li s1, 2
+	li t0, 1000
+loop:
+	subi t0, t0, 1
+	bnez t0, loop
+	li s1, 3
+	stx zero, -7	// stop hart 0
+	li s1, 4
+	ret
@@ -0,0 +1,15 @@
+// emu-test.sh snapshots: 1000 trips round a loop, a snapshot,
+// then 5000 more
+
+start:
+	li t0, 1000
+first:
+	subi t0, t0, 1
+	bnez t0, first
+	stx zero, -8	// snapshot and carry on
+	li t0, 5000
+second:
+	subi t0, t0, 1
+	bnez t0, second
+	li a0, 0
+	ret